@@ -0,0 +1,487 @@
+#include "Spline.hpp"
+#include "SplineCursor.hpp"
+#include "File.hpp"
+#include "Allocation.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+using Clock = std::chrono::high_resolution_clock;
+
+static uint32_t random_state = 12345;
+
+static float random_float(float lo, float hi)
+{
+    random_state = random_state * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (random_state >> 8) / 16777216.0f;
+}
+
+static Spline make_track(size_t count, float control_scale)
+{
+    Spline spline;
+    spline.BeginEdit();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        float a = 6.2831853f * i / count;
+        float r = 0.5f * count;
+
+        spline.InsertPoint(vec3(
+            cosf(a) * r + random_float(-1.0f, 1.0f),
+            random_float(0.0f, 2.0f),
+            sinf(a) * r + random_float(-1.0f, 1.0f)));
+    }
+
+    // long random controls give tight loops and near cusps
+    for (size_t i = 0; i < count && control_scale > 0.0f; i++)
+    {
+        spline.MoveControl(i, spline.Node(i).point + control_scale * vec3(
+            random_float(-1.0f, 1.0f),
+            random_float(-1.0f, 1.0f),
+            random_float(-1.0f, 1.0f)));
+    }
+
+    spline.EndEdit();
+
+    return spline;
+}
+
+// the fixed step chord sum CalculateSegmentLength used previously
+static float legacy_segment_length(Spline& spline, int node)
+{
+    float length = 0.0f;
+    float step_size = 0.005f;
+
+    vec3 old_point, new_point;
+    old_point = spline.GetPoint(static_cast<float>(node));
+
+    for (float t = 0; t < 1.0f; t += step_size)
+    {
+        new_point = spline.GetPoint(static_cast<float>(node) + t);
+        length += glm::length(new_point - old_point);
+        old_point = new_point;
+    }
+
+    return length;
+}
+
+// dense chord sum of the segment evaluated in double precision
+static double reference_segment_length(Spline& spline, size_t node)
+{
+    const int steps = 20000;
+    size_t next = (node + 1) % spline.count;
+
+    dvec3 p0 = dvec3(spline.Node(node).point);
+    dvec3 p1 = p0 + dvec3(spline.Node(node).control);
+    dvec3 p3 = dvec3(spline.Node(next).point);
+    dvec3 p2 = p3 - dvec3(spline.Node(next).control);
+
+    double length = 0.0;
+    dvec3 old_point = p0;
+
+    for (int s = 1; s <= steps; s++)
+    {
+        double t = static_cast<double>(s) / steps;
+        double c = 1.0 - t;
+
+        dvec3 new_point =
+            p0 * (c * c * c) +
+            p1 * (3.0 * t * c * c) +
+            p2 * (3.0 * t * t * c) +
+            p3 * (t * t * t);
+
+        length += glm::length(new_point - old_point);
+        old_point = new_point;
+    }
+
+    return length;
+}
+
+template <typename F>
+static void report(
+    const char* name,
+    Spline& spline,
+    const std::vector<double>& reference,
+    F length)
+{
+    std::vector<float> result(spline.count);
+
+    auto start = Clock::now();
+
+    for (size_t i = 0; i < spline.count; i++)
+    {
+        result[i] = length(static_cast<int>(i));
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(
+        Clock::now() - start).count();
+
+    // relative to each segment's length, as the tolerance is
+    double error_sum = 0.0;
+    double error_max = 0.0;
+
+    for (size_t i = 0; i < spline.count; i++)
+    {
+        double error = fabs(result[i] - reference[i]) / reference[i];
+        error_sum += error;
+        error_max = error > error_max ? error : error_max;
+    }
+
+    printf("  %-24s %10.1f ns/segment   mean error %.3e   max error %.3e\n",
+        name,
+        ns / spline.count,
+        error_sum / spline.count,
+        error_max);
+}
+
+static void bench_segment_length(const char* name, float control_scale)
+{
+    const size_t count = 1000;
+    Spline spline = make_track(count, control_scale);
+
+    std::vector<double> reference(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        reference[i] = reference_segment_length(spline, i);
+    }
+
+    printf("CalculateSegmentLength, %s segments\n", name);
+
+    report("chord sum (200 steps)", spline, reference, [&](int i)
+    {
+        return legacy_segment_length(spline, i);
+    });
+
+    const float tolerances[] = { 1e-2f, 1e-3f, 1e-4f, 1e-5f };
+
+    for (float tolerance : tolerances)
+    {
+        char label[64];
+        snprintf(label, sizeof(label), "gauss-legendre (%.0e)", tolerance);
+
+        spline.length_tolerance = tolerance;
+
+        report(label, spline, reference, [&](int i)
+        {
+            return spline.CalculateSegmentLength(i);
+        });
+    }
+
+    printf("\n");
+}
+
+template <typename F>
+static double time_ns(F f)
+{
+    auto start = Clock::now();
+    f();
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+static void bench_batch_evaluation()
+{
+    const size_t count = 1000;
+    const size_t n = 1 << 20;
+
+    Spline spline = make_track(count, 0.0f);
+
+    std::vector<float> f(n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        f[i] = static_cast<float>(count) * i / n;
+    }
+
+    std::vector<float> data(n * 9);
+    SplineSamples out;
+
+    for (int a = 0; a < 3; a++)
+    {
+        out.position[a] = &data[n * a];
+        out.gradient[a] = &data[n * (a + 3)];
+        out.normal[a] = &data[n * (a + 6)];
+    }
+
+    double scalar = time_ns([&]()
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            vec3 p = spline.GetPoint(f[i]);
+            vec3 g = spline.GetGradient(f[i]);
+            vec3 q = spline.GetNormal(f[i]);
+
+            for (int a = 0; a < 3; a++)
+            {
+                out.position[a][i] = p[a];
+                out.gradient[a][i] = g[a];
+                out.normal[a][i] = q[a];
+            }
+        }
+    });
+
+    double batch = time_ns([&]()
+    {
+        spline.Evaluate(f.data(), n, out);
+    });
+
+    printf("Evaluate, position + gradient + normal\n");
+    printf("  %-24s %10.1f ns/sample\n", "scalar", scalar / n);
+    printf("  %-24s %10.1f ns/sample\n", "batch", batch / n);
+    printf("\n");
+}
+
+static float sink = 0.0f;
+
+// times ops calls of f, reporting per call cost and items per second
+template <typename F>
+static void measure(
+    const char* name,
+    size_t nodes,
+    size_t ops,
+    double items_per_op,
+    const char* items,
+    F f)
+{
+    AllocationCounters before = allocation_total();
+
+    auto start = Clock::now();
+
+    for (size_t i = 0; i < ops; i++)
+    {
+        f(i);
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(
+        Clock::now() - start).count();
+
+    AllocationCounters after = allocation_total();
+    double allocs = static_cast<double>(after.count - before.count) / ops;
+    double alloc_bytes = static_cast<double>(after.bytes - before.bytes) / ops;
+
+    printf("  %-26s %8zu %14.1f ns/op %10.2f allocs/op %12.0f B/op %12.3e %s/s\n",
+        name,
+        nodes,
+        ns / ops,
+        allocs,
+        alloc_bytes,
+        items_per_op * ops / (ns * 1e-9),
+        items);
+}
+
+// enough repeats to run a few million node operations per measurement
+static size_t repeats(size_t nodes, size_t work)
+{
+    size_t n = work / nodes;
+    return n < 1 ? 1 : n;
+}
+
+static void bench_api(size_t count)
+{
+    const size_t calls = 1 << 20;
+
+    Spline spline = make_track(count, 1.0f);
+
+    std::vector<float> f(calls);
+    std::vector<float> d(calls);
+
+    for (size_t i = 0; i < calls; i++)
+    {
+        f[i] = random_float(0.0f, static_cast<float>(count));
+        d[i] = random_float(0.0f, spline.total_length);
+    }
+
+    measure("Update (all segments)", count, repeats(count, 1 << 20), count, "segments",
+        [&](size_t)
+    {
+        spline.Invalidate();
+        spline.Update();
+    });
+
+    measure("Rebuild", count, repeats(count, 1 << 20), count, "segments",
+        [&](size_t)
+    {
+        spline.Rebuild();
+    });
+
+    measure("Update (one node moved)", count, 1 << 14, 1, "edits",
+        [&](size_t i)
+    {
+        size_t node = (i * 7919) % count;
+        spline.MovePoint(node, spline.Node(node).point + vec3(0.0f, 1e-3f, 0.0f));
+    });
+
+    measure("GetPoint", count, calls, 1, "calls",
+        [&](size_t i)
+    {
+        sink += spline.GetPoint(f[i]).x;
+    });
+
+    measure("GetGradient", count, calls, 1, "calls",
+        [&](size_t i)
+    {
+        sink += spline.GetGradient(f[i]).x;
+    });
+
+    measure("GetNormal", count, calls, 1, "calls",
+        [&](size_t i)
+    {
+        sink += spline.GetNormal(f[i]).x;
+    });
+
+    measure("GetNormalisedOffset", count, calls, 1, "calls",
+        [&](size_t i)
+    {
+        sink += spline.GetNormalisedOffset(d[i]);
+    });
+
+    // a full lap in even steps, as an export or simulation walks it
+    float step = spline.total_length / calls;
+
+    measure("walk, search per sample", count, calls, 1, "samples",
+        [&](size_t i)
+    {
+        float t = 0.0f;
+        size_t segment = spline.FindParameter(step * i, t);
+        sink += spline.GetPoint(segment, t).x + spline.GetGradient(segment, t).x +
+            spline.GetFrame(segment, t).w;
+    });
+
+    SplineCursor cursor(spline);
+
+    measure("walk, SplineCursor", count, calls, 1, "samples",
+        [&](size_t)
+    {
+        SplineCursorSample sample = cursor.Advance(step);
+        sink += sample.position.x + sample.tangent.x + sample.frame.w;
+    });
+
+    measure("CalculateSegmentLength", count, 1 << 16, 1, "segments",
+        [&](size_t i)
+    {
+        sink += spline.CalculateSegmentLength(static_cast<int>(i % count));
+    });
+
+    std::string file;
+    {
+        std::ostringstream os;
+        save_track(os, spline);
+        file = os.str();
+    }
+
+    std::string file_v1;
+    {
+        std::vector<vec3> points, controls, normals;
+        std::vector<float> lengths;
+
+        for (size_t i = 0; i < spline.count; i++)
+        {
+            points.push_back(spline.Node(i).point);
+            controls.push_back(spline.Node(i).control);
+            normals.push_back(spline.Node(i).normal);
+            lengths.push_back(spline.Length(i));
+        }
+
+        std::ostringstream os;
+        serialize(os, points);
+        serialize(os, controls);
+        serialize(os, normals);
+        serialize(os, lengths);
+        file_v1 = os.str();
+    }
+
+    const char* path = "superrocket-bench.track";
+    {
+        std::ofstream os(path, std::ios::binary);
+        os.write(file.data(), file.size());
+    }
+
+    double megabytes = file.size() / 1e6;
+
+    measure("save_track", count, repeats(count, 1 << 22), megabytes, "MB",
+        [&](size_t)
+    {
+        std::ostringstream os;
+        save_track(os, spline);
+        sink += static_cast<float>(os.tellp());
+    });
+
+    measure("load_track (stream)", count, repeats(count, 1 << 22), megabytes, "MB",
+        [&](size_t)
+    {
+        std::istringstream is(file);
+        Spline loaded;
+        load_track(is, loaded);
+        sink += loaded.total_length;
+    });
+
+    measure("load_track (mapped)", count, repeats(count, 1 << 22), megabytes, "MB",
+        [&](size_t)
+    {
+        Spline loaded;
+        load_track(std::string(path), loaded);
+        sink += loaded.total_length;
+    });
+
+    measure("load_track (v1 import)", count, repeats(count, 1 << 20), file_v1.size() / 1e6, "MB",
+        [&](size_t)
+    {
+        std::istringstream is(file_v1);
+        Spline loaded;
+        load_track(is, loaded);
+        sink += loaded.total_length;
+    });
+
+    remove(path);
+}
+
+int main(int argc, char *argv[])
+{
+    // the largest track size to run, to keep quick runs short
+    size_t max_nodes = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+
+    bench_segment_length("smooth", 0.0f);
+    bench_segment_length("tight", 4.0f);
+    bench_batch_evaluation();
+
+    const size_t sizes[] = { 10, 1000, 100000, 1000000 };
+
+    printf("Spline\n");
+
+    for (size_t count : sizes)
+    {
+        if (count <= max_nodes)
+        {
+            bench_api(count);
+        }
+    }
+
+    printf("\n");
+
+    // every allocation the process made, by what it was made for
+    printf("Allocations\n");
+
+    for (size_t i = 0; i < static_cast<size_t>(AllocationTag::COUNT); i++)
+    {
+        AllocationTag tag = static_cast<AllocationTag>(i);
+        AllocationCounters counters = allocation_total(tag);
+
+        printf("  %-26s %14llu allocs %16llu B\n",
+            allocation_tag_name(tag),
+            static_cast<unsigned long long>(counters.count),
+            static_cast<unsigned long long>(counters.bytes));
+    }
+
+    printf("\n");
+
+    if (sink == 1.0f)
+    {
+        printf("%f\n", sink);
+    }
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include "Allocation.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+static const size_t tag_count = static_cast<size_t>(AllocationTag::COUNT);
+
+// everything here is read from inside operator new, so it is all plain
+// data that needs no constructor or lock
+static std::atomic<uint64_t> total_counts[tag_count];
+static std::atomic<uint64_t> total_bytes[tag_count];
+
+static thread_local AllocationTag current_tag = AllocationTag::OTHER;
+static thread_local uint64_t thread_counts[tag_count];
+static thread_local uint64_t thread_bytes[tag_count];
+
+static std::atomic<bool> tracking(false);
+
+static uint64_t frame_start_counts[tag_count];
+static uint64_t frame_start_bytes[tag_count];
+static AllocationCounters last_frame[tag_count];
+static uint32_t frame_counts[allocation_frame_history];
+static size_t frame_total = 0;
+
+AllocationScope::AllocationScope(AllocationTag tag) :
+    previous(current_tag)
+{
+    current_tag = tag;
+}
+
+AllocationScope::~AllocationScope()
+{
+    current_tag = previous;
+}
+
+void allocation_record(size_t size)
+{
+    size_t tag = static_cast<size_t>(current_tag);
+
+    total_counts[tag].fetch_add(1, std::memory_order_relaxed);
+    total_bytes[tag].fetch_add(size, std::memory_order_relaxed);
+
+    thread_counts[tag]++;
+    thread_bytes[tag] += size;
+
+    if (!tracking.load(std::memory_order_relaxed))
+    {
+        tracking.store(true, std::memory_order_relaxed);
+    }
+}
+
+bool allocation_tracking()
+{
+    return tracking;
+}
+
+const char* allocation_tag_name(AllocationTag tag)
+{
+    static const char* names[tag_count] =
+    {
+        "other",
+        "system",
+        "spline",
+        "tessellation",
+        "picking",
+        "drawing",
+        "file",
+        "profiler",
+        "history"
+    };
+
+    size_t i = static_cast<size_t>(tag);
+    return i < tag_count ? names[i] : "unknown";
+}
+
+AllocationCounters allocation_total()
+{
+    AllocationCounters counters;
+
+    for (size_t i = 0; i < tag_count; i++)
+    {
+        counters.count += total_counts[i].load(std::memory_order_relaxed);
+        counters.bytes += total_bytes[i].load(std::memory_order_relaxed);
+    }
+
+    return counters;
+}
+
+AllocationCounters allocation_total(AllocationTag tag)
+{
+    size_t i = static_cast<size_t>(tag);
+
+    AllocationCounters counters;
+    counters.count = total_counts[i].load(std::memory_order_relaxed);
+    counters.bytes = total_bytes[i].load(std::memory_order_relaxed);
+
+    return counters;
+}
+
+uint64_t allocation_thread_count()
+{
+    uint64_t count = 0;
+
+    for (size_t i = 0; i < tag_count; i++)
+    {
+        count += thread_counts[i];
+    }
+
+    return count;
+}
+
+void allocation_frame()
+{
+    uint64_t count = 0;
+
+    for (size_t i = 0; i < tag_count; i++)
+    {
+        last_frame[i].count = thread_counts[i] - frame_start_counts[i];
+        last_frame[i].bytes = thread_bytes[i] - frame_start_bytes[i];
+        frame_start_counts[i] = thread_counts[i];
+        frame_start_bytes[i] = thread_bytes[i];
+
+        count += last_frame[i].count;
+    }
+
+    frame_counts[frame_total % allocation_frame_history] =
+        static_cast<uint32_t>(std::min<uint64_t>(count, UINT32_MAX));
+    frame_total++;
+}
+
+AllocationCounters allocation_last_frame(AllocationTag tag)
+{
+    return last_frame[static_cast<size_t>(tag)];
+}
+
+uint64_t allocation_last_frame_count()
+{
+    uint64_t count = 0;
+
+    for (size_t i = 0; i < tag_count; i++)
+    {
+        count += last_frame[i].count;
+    }
+
+    return count;
+}
+
+size_t allocation_frame_counts(uint32_t* counts, size_t max)
+{
+    size_t n = std::min(std::min(frame_total, allocation_frame_history), max);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        counts[i] = frame_counts[(frame_total - n + i) % allocation_frame_history];
+    }
+
+    return n;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// what an allocation was made for, set per thread by ALLOCATION_TAG
+enum class AllocationTag : uint8_t
+{
+    OTHER,
+    SYSTEM,
+    SPLINE,
+    TESSELLATION,
+    PICKING,
+    DRAWING,
+    FILE,
+    PROFILER,
+    HISTORY,
+    COUNT
+};
+
+#define ALLOCATION_CONCAT_INNER(a, b) a##b
+#define ALLOCATION_CONCAT(a, b) ALLOCATION_CONCAT_INNER(a, b)
+
+// tags allocations made on this thread until the end of the scope
+#define ALLOCATION_TAG(tag) AllocationScope ALLOCATION_CONCAT(allocation_scope_, __LINE__)(tag)
+
+struct AllocationCounters
+{
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+class AllocationScope
+{
+public:
+    explicit AllocationScope(AllocationTag tag);
+    ~AllocationScope();
+
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+private:
+    AllocationTag previous;
+};
+
+// called by the operator new hooks, which are only linked into builds
+// with SUPERROCKET_ALLOCATION_TRACKING and the benchmarks. counters stay
+// at zero otherwise.
+void allocation_record(size_t size);
+bool allocation_tracking();
+
+const char* allocation_tag_name(AllocationTag tag);
+
+// totals over all threads since startup
+AllocationCounters allocation_total();
+AllocationCounters allocation_total(AllocationTag tag);
+
+// allocations made by the calling thread since startup
+uint64_t allocation_thread_count();
+
+// closes a frame of the calling thread, keeping what each tag allocated
+// since the last call. like the frame times, frames must be closed and
+// read from one thread.
+void allocation_frame();
+
+// per tag counts of the last closed frame
+AllocationCounters allocation_last_frame(AllocationTag tag);
+uint64_t allocation_last_frame_count();
+
+// copies up to max per frame allocation counts, oldest first
+size_t allocation_frame_counts(uint32_t* counts, size_t max);
+
+static const size_t allocation_frame_history = 240;
@@ -0,0 +1,71 @@
+#include "Allocation.hpp"
+
+#include <cstdlib>
+#include <new>
+
+// replaces the global allocator to count through allocation_record. kept
+// out of the core library so each executable opts in.
+
+static void* counted_alloc(size_t size)
+{
+    allocation_record(size);
+
+    return malloc(size > 0 ? size : 1);
+}
+
+void* operator new(size_t size)
+{
+    void* p = counted_alloc(size);
+
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    free(p);
+}
@@ -0,0 +1,420 @@
+#include "Autosave.hpp"
+
+#include "Allocation.hpp"
+#include "File.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char journal_magic[8] = { 'S', 'R', 'J', 'O', 'U', 'R', 'N', 0 };
+static const uint32_t journal_version = 1;
+
+std::string journal_path(const std::string& track_path)
+{
+    return track_path + ".journal";
+}
+
+// writes to the end of a file, or over it if truncate is set, and only
+// returns once the data has reached the disk
+static bool write_synced(
+    const std::string& path,
+    const void* data,
+    size_t size,
+    bool truncate)
+{
+#ifdef _WIN32
+    int flags = _O_WRONLY | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : _O_APPEND);
+    int fd = _open(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    bool ok = _write(fd, data, static_cast<unsigned>(size)) == static_cast<int>(size);
+    ok = _commit(fd) == 0 && ok;
+    _close(fd);
+
+    return ok;
+#else
+    int flags = O_WRONLY | O_CREAT | (truncate ? O_TRUNC : O_APPEND);
+    int fd = open(path.c_str(), flags, 0644);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    const char* p = static_cast<const char*>(data);
+    bool ok = true;
+
+    while (size > 0 && ok)
+    {
+        ssize_t written = write(fd, p, size);
+        ok = written > 0;
+
+        if (ok)
+        {
+            p += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+    ok = fsync(fd) == 0 && ok;
+    close(fd);
+
+    return ok;
+#endif
+}
+
+static bool replace_file(
+    const std::string& from,
+    const std::string& to)
+{
+#ifdef _WIN32
+    return MoveFileExA(
+        from.c_str(),
+        to.c_str(),
+        MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+static JournalRecord make_record(const SplineEdit& edit)
+{
+    JournalRecord record = {};
+    record.type = static_cast<uint32_t>(edit.type);
+    record.index = edit.index;
+    record.position[0] = edit.position.x;
+    record.position[1] = edit.position.y;
+    record.position[2] = edit.position.z;
+    record.crc = crc32(&record, offsetof(JournalRecord, crc));
+
+    return record;
+}
+
+static bool read_record(
+    const JournalRecord& record,
+    SplineEdit& edit)
+{
+    if (crc32(&record, offsetof(JournalRecord, crc)) != record.crc ||
+        record.type > static_cast<uint32_t>(SplineEditType::INSERT_POINT_BEFORE))
+    {
+        return false;
+    }
+
+    edit.type = static_cast<SplineEditType>(record.type);
+    edit.index = static_cast<size_t>(record.index);
+    edit.position = vec3(
+        record.position[0],
+        record.position[1],
+        record.position[2]);
+
+    return true;
+}
+
+static JournalHeader make_header(uint32_t track_crc)
+{
+    JournalHeader header = {};
+    memcpy(header.magic, journal_magic, sizeof(journal_magic));
+    header.version = journal_version;
+    header.track_crc = track_crc;
+
+    return header;
+}
+
+// copies only what saving reads
+static std::shared_ptr<Spline> make_snapshot(const Spline& spline)
+{
+    auto copy = std::make_shared<Spline>();
+    copy->count = spline.count;
+    copy->nodes = spline.nodes;
+    copy->dirty_segments = spline.dirty_segments;
+    copy->dirty_frames = spline.dirty_frames;
+    copy->invalid = spline.invalid;
+
+    return copy;
+}
+
+TrackAutosave::TrackAutosave()
+{
+    worker = std::thread([this]()
+    {
+        Run();
+    });
+}
+
+TrackAutosave::~TrackAutosave()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+
+    wake.notify_one();
+    worker.join();
+}
+
+size_t TrackAutosave::Open(const std::string& path, Spline& spline)
+{
+    Wait();
+
+    // a journal only applies to the exact file it was started from
+    uint32_t crc = 0;
+    bool valid = false;
+    {
+        MappedFile file;
+        TrackView view;
+        valid = file.Open(path) && view.Open(file.Data(), file.Size());
+        crc = view.TableCrc();
+    }
+
+    std::vector<JournalRecord> replayed;
+    bool current = false;
+    bool torn = false;
+
+    std::ifstream journal(
+        journal_path(path),
+        std::ios::binary);
+
+    JournalHeader header;
+
+    if (valid &&
+        journal.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+        memcmp(header.magic, journal_magic, sizeof(journal_magic)) == 0 &&
+        header.version == journal_version &&
+        header.track_crc == crc)
+    {
+        current = true;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            replaying = true;
+        }
+
+        spline.BeginEdit();
+
+        JournalRecord record;
+        SplineEdit edit;
+
+        while (journal.read(reinterpret_cast<char*>(&record), sizeof(record)))
+        {
+            if (!read_record(record, edit))
+            {
+                torn = true;
+                break;
+            }
+
+            // inserts may add to the end, every other edit needs a node
+            size_t end = spline.count;
+
+            if (edit.type == SplineEditType::INSERT_POINT_BEFORE)
+            {
+                end++;
+            }
+
+            if (edit.type != SplineEditType::INSERT_POINT && edit.index >= end)
+            {
+                torn = true;
+                break;
+            }
+
+            spline.Apply(edit);
+            replayed.push_back(record);
+        }
+
+        // a partial record left by a crash
+        torn = torn || journal.gcount() > 0;
+
+        spline.EndEdit();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        replaying = false;
+    }
+
+    journal.close();
+
+    // appending after a torn record would hide everything that follows
+    if (torn)
+    {
+        write_synced(journal_path(path), &header, sizeof(header), true);
+        write_synced(
+            journal_path(path),
+            replayed.data(),
+            replayed.size() * sizeof(JournalRecord),
+            false);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    track_path = path;
+    journal_crc = crc;
+    journal_enabled = valid;
+    journal_reset = !current;
+
+    return replayed.size();
+}
+
+void TrackAutosave::Save(const std::string& path, const Spline& spline)
+{
+    std::shared_ptr<Spline> copy = make_snapshot(spline);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // the snapshot already holds every edit queued so far
+        snapshot = copy;
+        snapshot_path = path;
+        records.clear();
+
+        track_path = path;
+        journal_enabled = true;
+    }
+
+    wake.notify_one();
+}
+
+void TrackAutosave::Record(const SplineEdit& edit)
+{
+    JournalRecord record = make_record(edit);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!journal_enabled || replaying)
+    {
+        return;
+    }
+
+    records.push_back(record);
+
+    if (records.size() == 1)
+    {
+        wake.notify_one();
+    }
+}
+
+void TrackAutosave::Wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    idle.wait(lock, [this]()
+    {
+        return !busy && !snapshot && records.empty();
+    });
+}
+
+void TrackAutosave::Run()
+{
+    ALLOCATION_TAG(AllocationTag::FILE);
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true)
+    {
+        busy = false;
+        idle.notify_all();
+
+        wake.wait(lock, [this]()
+        {
+            return stop || snapshot || !records.empty();
+        });
+
+        // let a burst of edits gather into one synced write
+        if (!snapshot && !stop)
+        {
+            wake.wait_for(lock, batch_interval, [this]()
+            {
+                return stop || snapshot != nullptr;
+            });
+        }
+
+        if (!snapshot && records.empty())
+        {
+            if (stop)
+            {
+                return;
+            }
+
+            continue;
+        }
+
+        busy = true;
+
+        std::shared_ptr<Spline> save;
+        save.swap(snapshot);
+        bool saving = save != nullptr;
+
+        std::vector<JournalRecord> batch;
+        batch.swap(records);
+
+        std::string save_path = snapshot_path;
+        std::string path = journal_path(track_path);
+        uint32_t crc = journal_crc;
+        bool enabled = journal_enabled;
+        bool reset = journal_reset;
+
+        lock.unlock();
+
+        if (saving)
+        {
+            std::ostringstream os;
+            crc = save_track(os, *save);
+            std::string data = os.str();
+            save.reset();
+
+            // written beside the track and moved over it, so a crash
+            // never leaves a half written track
+            std::string temp = save_path + ".tmp";
+            enabled =
+                write_synced(temp, data.data(), data.size(), true) &&
+                replace_file(temp, save_path);
+
+            std::string message = enabled ? "Saved: " : "Save failed: ";
+            std::cout << message + save_path + "\n" << std::flush;
+
+            path = journal_path(save_path);
+            reset = true;
+        }
+
+        if (enabled && reset)
+        {
+            JournalHeader header = make_header(crc);
+            reset = !write_synced(path, &header, sizeof(header), true);
+        }
+
+        if (enabled && !reset && !batch.empty())
+        {
+            write_synced(
+                path,
+                batch.data(),
+                batch.size() * sizeof(JournalRecord),
+                false);
+        }
+
+        lock.lock();
+
+        if (saving)
+        {
+            journal_crc = crc;
+            journal_enabled = enabled;
+        }
+
+        journal_reset = reset;
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Spline.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// one edit in the journal, checked by its own crc so a record torn by a
+// crash ends the replay
+struct JournalRecord
+{
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t index;
+    float position[3];
+    uint32_t crc;
+};
+
+// journals start with the table crc of the track file they apply to
+struct JournalHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t track_crc;
+};
+
+static_assert(sizeof(JournalRecord) == 32, "journal record layout");
+static_assert(sizeof(JournalHeader) == 16, "journal header layout");
+
+// saves tracks on a background thread from a snapshot, and between saves
+// appends every edit to a journal next to the track that is synced in
+// small batches, so a crash loses at most the last batch
+class TrackAutosave
+{
+public:
+    // time allowed for edits to gather into one synced journal write
+    std::chrono::milliseconds batch_interval = std::chrono::milliseconds(50);
+
+    TrackAutosave();
+    TrackAutosave(const TrackAutosave&) = delete;
+    TrackAutosave& operator=(const TrackAutosave&) = delete;
+    ~TrackAutosave();
+
+    // starts journalling a track just loaded from path, replaying any
+    // journal left by a crash onto it first, returns the edits replayed
+    size_t Open(const std::string& path, Spline& spline);
+
+    // snapshots the spline and writes it to path in the background, the
+    // journal restarts once the snapshot is on disk
+    void Save(const std::string& path, const Spline& spline);
+
+    // queues an edit for the journal, ignored until the track has a file
+    void Record(const SplineEdit& edit);
+
+    // blocks until everything queued has been written
+    void Wait();
+
+private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::thread worker;
+
+    bool stop = false;
+    bool busy = false;
+    bool replaying = false;
+
+    std::string track_path;
+
+    // crc of the track file the journal on disk belongs to, the journal
+    // is rewritten from its header before the next append if reset is set
+    uint32_t journal_crc = 0;
+    bool journal_enabled = false;
+    bool journal_reset = false;
+
+    std::shared_ptr<Spline> snapshot;
+    std::string snapshot_path;
+    std::vector<JournalRecord> records;
+
+    void Run();
+};
+
+std::string journal_path(const std::string& track_path);
@@ -0,0 +1,281 @@
+#include "Culling.hpp"
+
+#include <algorithm>
+
+Frustum Frustum::FromMatrix(const mat4& m)
+{
+    // rows of the matrix, glm stores columns
+    vec4 r0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    vec4 r1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    vec4 r2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    vec4 r3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum frustum;
+    frustum.planes[0] = r3 + r0;
+    frustum.planes[1] = r3 - r0;
+    frustum.planes[2] = r3 + r1;
+    frustum.planes[3] = r3 - r1;
+    frustum.planes[4] = r3 - r2;
+
+    return frustum;
+}
+
+FrustumTest Frustum::Test(const Aabb& box) const
+{
+    FrustumTest result = FrustumTest::INSIDE;
+
+    for (int i = 0; i < plane_count; i++)
+    {
+        const vec4& p = planes[i];
+
+        // corners furthest along and against the plane normal
+        vec3 positive(
+            p.x >= 0 ? box.max.x : box.min.x,
+            p.y >= 0 ? box.max.y : box.min.y,
+            p.z >= 0 ? box.max.z : box.min.z);
+
+        vec3 negative(
+            p.x >= 0 ? box.min.x : box.max.x,
+            p.y >= 0 ? box.min.y : box.max.y,
+            p.z >= 0 ? box.min.z : box.max.z);
+
+        if (glm::dot(vec3(p), positive) + p.w < 0)
+        {
+            return FrustumTest::OUTSIDE;
+        }
+
+        if (glm::dot(vec3(p), negative) + p.w < 0)
+        {
+            result = FrustumTest::INTERSECTS;
+        }
+    }
+
+    return result;
+}
+
+void Bvh::Resize(size_t count)
+{
+    if (count == leaf_count && !nodes.empty())
+    {
+        return;
+    }
+
+    size_t base = 1;
+
+    while (base < count)
+    {
+        base *= 2;
+    }
+
+    // keep the leaves that still exist
+    std::vector<Aabb> leaves;
+
+    if (leaf_count > 0)
+    {
+        leaves.assign(
+            nodes.begin() + leaf_base,
+            nodes.begin() + leaf_base + glm::min(leaf_count, count));
+    }
+
+    leaf_count = count;
+    leaf_base = base;
+
+    nodes.assign(leaf_base * 2, Aabb());
+    std::copy(leaves.begin(), leaves.end(), nodes.begin() + leaf_base);
+
+    dirty.clear();
+    RefitAll();
+}
+
+void Bvh::Insert(size_t i, const Aabb& box)
+{
+    size_t count = leaf_count + 1;
+
+    if (nodes.empty() || count > leaf_base)
+    {
+        Resize(count);
+    }
+
+    leaf_count = count;
+
+    auto leaves = nodes.begin() + leaf_base;
+    std::copy_backward(leaves + i, leaves + count - 1, leaves + count);
+    leaves[i] = box;
+
+    RefitRange(i, count);
+}
+
+void Bvh::Erase(size_t i)
+{
+    auto leaves = nodes.begin() + leaf_base;
+    std::copy(leaves + i + 1, leaves + leaf_count, leaves + i);
+    leaves[leaf_count - 1] = Aabb();
+
+    RefitRange(i, leaf_count);
+
+    leaf_count--;
+}
+
+void Bvh::SetLeaf(size_t i, const Aabb& box)
+{
+    nodes[leaf_base + i] = box;
+    dirty.push_back(leaf_base + i);
+}
+
+void Bvh::Refit()
+{
+    if (dirty.empty())
+    {
+        return;
+    }
+
+    // walking up from each leaf only pays off for a few edits
+    size_t depth = 1;
+
+    for (size_t n = leaf_base; n > 1; n /= 2)
+    {
+        depth++;
+    }
+
+    if (dirty.size() * depth > leaf_base)
+    {
+        RefitAll();
+    }
+    else
+    {
+        for (size_t node : dirty)
+        {
+            for (node /= 2; node >= 1; node /= 2)
+            {
+                Aabb parent = nodes[node * 2];
+                parent.Extend(nodes[node * 2 + 1]);
+                nodes[node] = parent;
+            }
+        }
+    }
+
+    dirty.clear();
+}
+
+void Bvh::RefitAll()
+{
+    for (size_t node = leaf_base - 1; node >= 1; node--)
+    {
+        Aabb parent = nodes[node * 2];
+        parent.Extend(nodes[node * 2 + 1]);
+        nodes[node] = parent;
+    }
+}
+
+// leaves first to last, exclusive, and every node above them
+void Bvh::RefitRange(size_t first, size_t last)
+{
+    if (first >= last)
+    {
+        return;
+    }
+
+    size_t lo = leaf_base + first;
+    size_t hi = leaf_base + last - 1;
+
+    while (lo > 1)
+    {
+        lo /= 2;
+        hi /= 2;
+
+        for (size_t node = lo; node <= hi; node++)
+        {
+            Aabb parent = nodes[node * 2];
+            parent.Extend(nodes[node * 2 + 1]);
+            nodes[node] = parent;
+        }
+    }
+}
+
+const Aabb& Bvh::GetLeaf(size_t i) const
+{
+    return nodes[leaf_base + i];
+}
+
+size_t Bvh::Size() const
+{
+    return leaf_count;
+}
+
+Aabb Bvh::Bounds() const
+{
+    return leaf_count > 0 ? nodes[1] : Aabb();
+}
+
+void Bvh::Cull(
+    const Frustum& frustum,
+    float margin,
+    bool ground,
+    std::vector<size_t>& visible) const
+{
+    if (leaf_count == 0)
+    {
+        return;
+    }
+
+    // node, and the number of leaves below it
+    size_t stack[64][2];
+    size_t top = 0;
+
+    stack[top][0] = 1;
+    stack[top][1] = leaf_base;
+    top++;
+
+    while (top > 0)
+    {
+        top--;
+        size_t node = stack[top][0];
+        size_t span = stack[top][1];
+
+        Aabb box = nodes[node];
+
+        if (box.Empty())
+        {
+            continue;
+        }
+
+        box.min -= vec3(margin);
+        box.max += vec3(margin);
+
+        if (ground)
+        {
+            box.min.y = glm::min(box.min.y, 0.0f);
+            box.max.y = glm::max(box.max.y, 0.0f);
+        }
+
+        FrustumTest test = frustum.Test(box);
+
+        if (test == FrustumTest::OUTSIDE)
+        {
+            continue;
+        }
+
+        if (test == FrustumTest::INSIDE || span == 1)
+        {
+            // whole subtree is visible
+            size_t first = node * span - leaf_base;
+            size_t last = glm::min(first + span, leaf_count);
+
+            for (size_t i = first; i < last; i++)
+            {
+                visible.push_back(i);
+            }
+
+            continue;
+        }
+
+        // right first so leaves come out in index order
+        stack[top][0] = node * 2 + 1;
+        stack[top][1] = span / 2;
+        top++;
+
+        stack[top][0] = node * 2;
+        stack[top][1] = span / 2;
+        top++;
+    }
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Math.hpp"
+
+#include <cfloat>
+#include <vector>
+
+struct Aabb
+{
+    vec3 min = vec3(FLT_MAX);
+    vec3 max = vec3(-FLT_MAX);
+
+    bool Empty() const
+    {
+        return min.x > max.x;
+    }
+
+    void Extend(vec3 p)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void Extend(const Aabb& box)
+    {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+};
+
+enum class FrustumTest
+{
+    OUTSIDE,
+    INTERSECTS,
+    INSIDE
+};
+
+// side and far planes of a projection, as n.p + d >= 0 for points inside,
+// the near plane is left to line clipping
+struct Frustum
+{
+    static const int plane_count = 5;
+
+    vec4 planes[plane_count];
+
+    static Frustum FromMatrix(const mat4& projection_view);
+
+    FrustumTest Test(const Aabb& box) const;
+};
+
+// bounding volume hierarchy over items in index order, stored as an
+// implicit complete binary tree so an edited leaf refits in O(log n)
+class Bvh
+{
+public:
+    void Resize(size_t count);
+
+    // moves the leaves after i along by one, refitting only the nodes
+    // above them
+    void Insert(size_t i, const Aabb& box);
+    void Erase(size_t i);
+
+    void SetLeaf(size_t i, const Aabb& box);
+    void Refit();
+    const Aabb& GetLeaf(size_t i) const;
+    size_t Size() const;
+
+    // box around every item, as of the last refit
+    Aabb Bounds() const;
+
+    // appends the items inside the frustum in index order, with every box
+    // grown by margin and, if ground is set, down to the y = 0 plane
+    void Cull(
+        const Frustum& frustum,
+        float margin,
+        bool ground,
+        std::vector<size_t>& visible) const;
+
+    // appends the items whose boxes pass test in index order, descending
+    // only into nodes whose boxes pass it too
+    template <typename F, typename Items>
+    void Query(
+        F test,
+        Items& items) const;
+
+private:
+    size_t leaf_count = 0;
+    size_t leaf_base = 1;
+
+    // nodes[1] is the root, leaves start at leaf_base
+    std::vector<Aabb> nodes;
+
+    // leaves set since the last Refit
+    std::vector<size_t> dirty;
+
+    void RefitAll();
+    void RefitRange(size_t first, size_t last);
+};
+
+template <typename F, typename Items>
+void Bvh::Query(
+    F test,
+    Items& items) const
+{
+    if (leaf_count == 0)
+    {
+        return;
+    }
+
+    size_t stack[64];
+    size_t top = 0;
+
+    stack[top++] = 1;
+
+    while (top > 0)
+    {
+        size_t node = stack[--top];
+        const Aabb& box = nodes[node];
+
+        if (box.Empty() || !test(box))
+        {
+            continue;
+        }
+
+        if (node >= leaf_base)
+        {
+            items.push_back(node - leaf_base);
+            continue;
+        }
+
+        stack[top++] = node * 2 + 1;
+        stack[top++] = node * 2;
+    }
+}
@@ -0,0 +1,111 @@
+#include "DrawCommands.hpp"
+
+void DrawCommandBuffer::SetColor(
+    uint8_t r,
+    uint8_t g,
+    uint8_t b,
+    uint8_t a)
+{
+    color =
+        (static_cast<uint32_t>(r) << 24) |
+        (static_cast<uint32_t>(g) << 16) |
+        (static_cast<uint32_t>(b) << 8) |
+        static_cast<uint32_t>(a);
+}
+
+void DrawCommandBuffer::GetColor(
+    uint8_t& r,
+    uint8_t& g,
+    uint8_t& b,
+    uint8_t& a) const
+{
+    r = static_cast<uint8_t>(color >> 24);
+    g = static_cast<uint8_t>(color >> 16);
+    b = static_cast<uint8_t>(color >> 8);
+    a = static_cast<uint8_t>(color);
+}
+
+static uint64_t batch_key(DrawPrimitive primitive, uint32_t color)
+{
+    return (static_cast<uint64_t>(primitive) << 32) | color;
+}
+
+ArenaVector<float>& DrawCommandBuffer::Batch(DrawPrimitive primitive)
+{
+    uint64_t key = batch_key(primitive, color);
+
+    // only the last batch can be added to, as joining an earlier one
+    // would draw over what came after it
+    if (current_valid && current_key == key)
+    {
+        return batches[current].data;
+    }
+
+    if (batch_count == batches.size())
+    {
+        batches.emplace_back();
+    }
+
+    current = batch_count++;
+
+    DrawBatch& batch = batches[current];
+    batch.primitive = primitive;
+    GetColor(batch.r, batch.g, batch.b, batch.a);
+
+    current_valid = true;
+    current_key = key;
+
+    return batch.data;
+}
+
+void DrawCommandBuffer::Line(
+    float x0,
+    float y0,
+    float x1,
+    float y1)
+{
+    ArenaVector<float>& data = Batch(DrawPrimitive::LINE);
+    data.push_back(x0);
+    data.push_back(y0);
+    data.push_back(x1);
+    data.push_back(y1);
+}
+
+void DrawCommandBuffer::Circle(
+    float x,
+    float y,
+    float radius,
+    bool filled)
+{
+    ArenaVector<float>& data = Batch(
+        filled ? DrawPrimitive::FILLED_CIRCLE : DrawPrimitive::CIRCLE);
+    data.push_back(x);
+    data.push_back(y);
+    data.push_back(radius);
+}
+
+void DrawCommandBuffer::Clear()
+{
+    // the data goes with the frame arena, only the batches are kept
+    for (size_t i = 0; i < batch_count; i++)
+    {
+        batches[i].data = ArenaVector<float>();
+    }
+
+    batch_count = 0;
+    current_valid = false;
+}
+
+size_t DrawCommandBuffer::PrimitiveCount() const
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < batch_count; i++)
+    {
+        const DrawBatch& batch = batches[i];
+        count += batch.data.size() /
+            (batch.primitive == DrawPrimitive::LINE ? 4 : 3);
+    }
+
+    return count;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "FrameArena.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class DrawPrimitive : uint8_t
+{
+    LINE,
+    CIRCLE,
+    FILLED_CIRCLE
+};
+
+// screen space primitives sharing a type and colour
+struct DrawBatch
+{
+    DrawPrimitive primitive = DrawPrimitive::LINE;
+    uint8_t r = 0;
+    uint8_t g = 0;
+    uint8_t b = 0;
+    uint8_t a = 0;
+
+    // lines are x0 y0 x1 y1, circles are x y radius, in the frame arena
+    ArenaVector<float> data;
+};
+
+// records a frame of draw calls grouped into batches, so submission cost
+// follows the number of batches rather than the number of primitives.
+// only consecutive calls of the same type and colour share a batch, so
+// drawing the batches in order keeps the order the calls were made in.
+class DrawCommandBuffer
+{
+public:
+    // batches in the order they were started, only the first batch_count
+    // are live
+    std::vector<DrawBatch> batches;
+    size_t batch_count = 0;
+
+    void SetColor(uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+    void GetColor(uint8_t& r, uint8_t& g, uint8_t& b, uint8_t& a) const;
+    void Line(float x0, float y0, float x1, float y1);
+    void Circle(float x, float y, float radius, bool filled);
+    void Clear();
+    size_t PrimitiveCount() const;
+
+private:
+    uint32_t color = 0xffffffff;
+    size_t current = 0;
+    bool current_valid = false;
+    uint64_t current_key = 0;
+
+    ArenaVector<float>& Batch(DrawPrimitive primitive);
+};
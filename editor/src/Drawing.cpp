@@ -1,8 +1,12 @@
 #include "Drawing.hpp"
 
+#include "Allocation.hpp"
+#include "Profiler.hpp"
+
 #include <SDL2_gfxPrimitives.h>
 
 SDL_Renderer* renderer = nullptr;
+DrawCommandBuffer draw_commands;
 
 int window_width = 0;
 int window_height = 0;
@@ -69,32 +73,33 @@ void draw_line_segment(
     float x1,
     float y1)
 {
-    SDL_RenderDrawLine(renderer,
-        static_cast<int>(x0), static_cast<int>(y0),
-        static_cast<int>(x1), static_cast<int>(y1));
+    draw_commands.Line(x0, y0, x1, y1);
+}
+
+void set_draw_color(
+    Uint8 r,
+    Uint8 g,
+    Uint8 b,
+    Uint8 a)
+{
+    draw_commands.SetColor(r, g, b, a);
 }
 
 void draw_point_3d(
     vec3 point,
     float size)
 {
-    Uint8 r, g, b, a;
-
-    SDL_GetRenderDrawColor(renderer,
-        &r, &g, &b, &a);
-
     vec4 p = projection_view * vec4(point, 1.0f);
     p = project_screen(p);
     if (p.z > -view_near_z)
     {
         int rad = static_cast<int>(size / p.w);
         rad = rad < 3 ? 3 : rad;
-        filledCircleRGBA(
-            renderer,
-            static_cast<Sint16>(p.x),
-            static_cast<Sint16>(p.y),
-            rad,
-            r, g, b, a);
+        draw_commands.Circle(
+            static_cast<float>(static_cast<Sint16>(p.x)),
+            static_cast<float>(static_cast<Sint16>(p.y)),
+            static_cast<float>(rad),
+            true);
     }
 }
 
@@ -125,6 +130,27 @@ void draw_line_3d(
     draw_line_segment(p0.x, p0.y, p1.x, p1.y);
 }
 
+void draw_pipeline(
+    VertexPipeline& pipeline)
+{
+    PROFILE_ZONE("draw pipeline");
+    ALLOCATION_TAG(AllocationTag::DRAWING);
+
+    ArenaVector<float> s;
+
+    pipeline.Run(
+        projection_view,
+        view_near_z,
+        static_cast<float>(window_width),
+        static_cast<float>(window_height),
+        s);
+
+    for (size_t i = 0; i + 3 < s.size(); i += 4)
+    {
+        draw_line_segment(s[i + 0], s[i + 1], s[i + 2], s[i + 3]);
+    }
+}
+
 void draw_circle(
     Sint16 x,
     Sint16 y,
@@ -133,12 +159,257 @@ void draw_circle(
     Uint8 g,
     Uint8 b)
 {
-    circleRGBA(
-        renderer,
-        x,
-        y,
-        rad,
-        r, g, b, 255);
+    Uint8 cr, cg, cb, ca;
+    draw_commands.GetColor(cr, cg, cb, ca);
+
+    draw_commands.SetColor(r, g, b, 255);
+    draw_commands.Circle(x, y, rad, false);
+    draw_commands.SetColor(cr, cg, cb, ca);
+}
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+// lines and filled circles become triangles with the colour in each
+// vertex, so a run of them in any colours goes out in one call and still
+// draws in the order it was recorded
+struct Geometry
+{
+    ArenaVector<SDL_Vertex> vertices;
+    ArenaVector<int> indices;
+};
+
+static void append_lines(
+    Geometry& geometry,
+    const DrawBatch& batch)
+{
+    SDL_Vertex vertex = {};
+    vertex.color = { batch.r, batch.g, batch.b, batch.a };
+
+    for (size_t i = 0; i + 3 < batch.data.size(); i += 4)
+    {
+        vec2 p0(batch.data[i + 0], batch.data[i + 1]);
+        vec2 p1(batch.data[i + 2], batch.data[i + 3]);
+
+        // a pixel wide quad, reaching half a pixel past both ends so the
+        // lines of a strip meet and a zero length line is still a dot
+        vec2 d = p1 - p0;
+        float length = glm::length(d);
+        d = length > 0.0f ? d * (0.5f / length) : vec2(0.5f, 0.0f);
+        vec2 n(-d.y, d.x);
+
+        const vec2 corners[4] = {
+            p0 - d + n,
+            p0 - d - n,
+            p1 + d - n,
+            p1 + d + n };
+
+        int first = static_cast<int>(geometry.vertices.size());
+
+        for (const vec2& corner : corners)
+        {
+            vertex.position.x = corner.x;
+            vertex.position.y = corner.y;
+            geometry.vertices.push_back(vertex);
+        }
+
+        const int quad[6] = { 0, 1, 2, 0, 2, 3 };
+
+        for (int k : quad)
+        {
+            geometry.indices.push_back(first + k);
+        }
+    }
+}
+
+static void append_filled_circles(
+    Geometry& geometry,
+    const DrawBatch& batch)
+{
+    SDL_Vertex vertex = {};
+    vertex.color = { batch.r, batch.g, batch.b, batch.a };
+
+    for (size_t i = 0; i + 2 < batch.data.size(); i += 3)
+    {
+        float x = batch.data[i + 0];
+        float y = batch.data[i + 1];
+        float rad = batch.data[i + 2];
+
+        // triangle fan around the centre, finer for larger circles
+        int sides = glm::clamp(static_cast<int>(rad), 8, 48);
+        int centre = static_cast<int>(geometry.vertices.size());
+
+        vertex.position.x = x;
+        vertex.position.y = y;
+        geometry.vertices.push_back(vertex);
+
+        for (int s = 0; s < sides; s++)
+        {
+            float a = glm::two_pi<float>() * s / sides;
+            vertex.position.x = x + cosf(a) * rad;
+            vertex.position.y = y + sinf(a) * rad;
+            geometry.vertices.push_back(vertex);
+
+            geometry.indices.push_back(centre);
+            geometry.indices.push_back(centre + 1 + s);
+            geometry.indices.push_back(centre + 1 + (s + 1) % sides);
+        }
+    }
+}
+
+static void flush_geometry(
+    Geometry& geometry)
+{
+    if (geometry.indices.empty())
+    {
+        return;
+    }
+
+    SDL_RenderGeometry(renderer, nullptr,
+        geometry.vertices.data(), static_cast<int>(geometry.vertices.size()),
+        geometry.indices.data(), static_cast<int>(geometry.indices.size()));
+
+    geometry.vertices.clear();
+    geometry.indices.clear();
+}
+#else
+#if SDL_VERSION_ATLEAST(2, 0, 10)
+typedef SDL_FPoint LinePoint;
+#else
+typedef SDL_Point LinePoint;
+#endif
+
+static void push_line_point(
+    ArenaVector<LinePoint>& line_points,
+    float x,
+    float y)
+{
+    LinePoint point;
+#if SDL_VERSION_ATLEAST(2, 0, 10)
+    point.x = x;
+    point.y = y;
+#else
+    point.x = static_cast<int>(x);
+    point.y = static_cast<int>(y);
+#endif
+    line_points.push_back(point);
+}
+
+// a polyline cannot skip from one line to the next without drawing the
+// gap, so one call draws each run of lines that join end to start
+static void flush_lines(
+    const DrawBatch& batch)
+{
+    const float* d = batch.data.data();
+    size_t n = batch.data.size() / 4;
+    size_t i = 0;
+
+    ArenaVector<LinePoint> line_points;
+    line_points.reserve(n * 2);
+
+    while (i < n)
+    {
+        line_points.clear();
+        push_line_point(line_points, d[i * 4 + 0], d[i * 4 + 1]);
+        push_line_point(line_points, d[i * 4 + 2], d[i * 4 + 3]);
+
+        while (i + 1 < n &&
+            d[i * 4 + 4] == d[i * 4 + 2] &&
+            d[i * 4 + 5] == d[i * 4 + 3])
+        {
+            i++;
+            push_line_point(line_points, d[i * 4 + 2], d[i * 4 + 3]);
+        }
+
+        i++;
+
+#if SDL_VERSION_ATLEAST(2, 0, 10)
+        SDL_RenderDrawLinesF(renderer,
+            line_points.data(), static_cast<int>(line_points.size()));
+#else
+        SDL_RenderDrawLines(renderer,
+            line_points.data(), static_cast<int>(line_points.size()));
+#endif
+    }
+}
+
+static void flush_filled_circles(
+    const DrawBatch& batch)
+{
+    for (size_t i = 0; i + 2 < batch.data.size(); i += 3)
+    {
+        filledCircleRGBA(
+            renderer,
+            static_cast<Sint16>(batch.data[i + 0]),
+            static_cast<Sint16>(batch.data[i + 1]),
+            static_cast<Sint16>(batch.data[i + 2]),
+            batch.r, batch.g, batch.b, batch.a);
+    }
+}
+#endif
+
+static void flush_circles(
+    const DrawBatch& batch)
+{
+    for (size_t i = 0; i + 2 < batch.data.size(); i += 3)
+    {
+        circleRGBA(
+            renderer,
+            static_cast<Sint16>(batch.data[i + 0]),
+            static_cast<Sint16>(batch.data[i + 1]),
+            static_cast<Sint16>(batch.data[i + 2]),
+            batch.r, batch.g, batch.b, batch.a);
+    }
+}
+
+void flush_draw_commands()
+{
+    PROFILE_ZONE("flush draw commands");
+    ALLOCATION_TAG(AllocationTag::DRAWING);
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    Geometry geometry;
+#endif
+
+    for (size_t i = 0; i < draw_commands.batch_count; i++)
+    {
+        const DrawBatch& batch = draw_commands.batches[i];
+
+        switch (batch.primitive)
+        {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        case DrawPrimitive::LINE:
+            append_lines(geometry, batch);
+            break;
+
+        case DrawPrimitive::FILLED_CIRCLE:
+            append_filled_circles(geometry, batch);
+            break;
+#else
+        case DrawPrimitive::LINE:
+            SDL_SetRenderDrawColor(renderer,
+                batch.r, batch.g, batch.b, batch.a);
+            flush_lines(batch);
+            break;
+
+        case DrawPrimitive::FILLED_CIRCLE:
+            flush_filled_circles(batch);
+            break;
+#endif
+
+        case DrawPrimitive::CIRCLE:
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+            // everything recorded before goes first
+            flush_geometry(geometry);
+#endif
+            flush_circles(batch);
+            break;
+        }
+    }
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    flush_geometry(geometry);
+#endif
+
+    draw_commands.Clear();
 }
 
 vec4 project_screen(
@@ -152,6 +423,12 @@ vec4 project_screen(
     return p;
 }
 
+float view_pixel_size()
+{
+    // project_screen spreads one unit of x over the window width
+    return 1.0f / (window_width * projection[0][0]);
+}
+
 vec3 unproject(
     vec2 screen_position)
 {
@@ -201,3 +478,21 @@ bool picking_raycast(
     return no_hit;
 }
 
+void picking_ray(
+    vec3& origin,
+    vec3& direction,
+    int16_t screen_x,
+    int16_t screen_y)
+{
+    // inverse of project_screen, onto the far plane
+    vec4 p(
+        static_cast<float>(screen_x) / window_width - 0.5f,
+        static_cast<float>(screen_y) / window_height - 0.5f,
+        1.0f,
+        1.0f);
+
+    p = glm::inverse(projection_view) * p;
+
+    origin = view_position;
+    direction = vec3(p) / p.w - view_position;
+}
@@ -1,11 +1,14 @@
 #pragma once
 
 #include "Math.hpp"
+#include "DrawCommands.hpp"
+#include "VertexPipeline.hpp"
 
 #include <SDL.h>
 
 extern int window_width, window_height;
 extern SDL_Renderer* renderer;
+extern DrawCommandBuffer draw_commands;
 
 extern vec3 view_position;
 extern float view_fov;
@@ -26,6 +29,12 @@ float plane_distance(
     vec3 plane_d,
     vec3 p);
 
+void set_draw_color(
+    Uint8 r,
+    Uint8 g,
+    Uint8 b,
+    Uint8 a);
+
 void draw_point_3d(
     vec3 point,
     float size);
@@ -34,6 +43,9 @@ void draw_line_3d(
     vec3 l0,
     vec3 l1);
 
+void draw_pipeline(
+    VertexPipeline& pipeline);
+
 void draw_circle(
     Sint16 x,
     Sint16 y,
@@ -42,9 +54,15 @@ void draw_circle(
     Uint8 g,
     Uint8 b);
 
+void flush_draw_commands();
+
 vec4 project_screen(
     vec4 p);
 
+// world size of one pixel at a view depth of one, as project_screen
+// places points
+float view_pixel_size();
+
 vec3 unproject(
     vec2 screen_position);
 
@@ -54,3 +72,9 @@ bool picking_raycast(
     vec3 plane_d,
     int16_t screen_x,
     int16_t screen_y);
+
+void picking_ray(
+    vec3& origin,
+    vec3& direction,
+    int16_t screen_x,
+    int16_t screen_y);
@@ -0,0 +1,654 @@
+#include "File.hpp"
+
+#include "Allocation.hpp"
+#include "Spline.hpp"
+
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char track_magic[8] = { 'S', 'R', 'T', 'R', 'A', 'C', 'K', 0 };
+
+static bool little_endian()
+{
+    uint16_t value = 1;
+    uint8_t first;
+    memcpy(&first, &value, 1);
+    return first == 1;
+}
+
+static size_t align_up(size_t offset)
+{
+    return (offset + track_alignment - 1) & ~(track_alignment - 1);
+}
+
+// tables for reading eight bytes per step
+struct Crc32Table
+{
+    uint32_t entries[8][256];
+
+    Crc32Table()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+
+            for (int k = 0; k < 8; k++)
+            {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+
+            entries[0][i] = c;
+        }
+
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            for (int k = 1; k < 8; k++)
+            {
+                uint32_t c = entries[k - 1][i];
+                entries[k][i] = entries[0][c & 0xff] ^ (c >> 8);
+            }
+        }
+    }
+};
+
+uint32_t crc32(const void* data, size_t size, uint32_t crc)
+{
+    static const Crc32Table table;
+    const uint32_t (*t)[256] = table.entries;
+
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+
+    // little endian only, as are the files
+    for (; size >= 8; size -= 8, p += 8)
+    {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+
+        crc =
+            t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^
+            t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+            t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+            t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    }
+
+    for (; size > 0; size--, p++)
+    {
+        crc = t[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string& path)
+{
+    Close();
+
+    HANDLE f = CreateFileA(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL);
+
+    if (f == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+
+    if (!GetFileSizeEx(f, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(f);
+        return false;
+    }
+
+    HANDLE m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (m == NULL)
+    {
+        CloseHandle(f);
+        return false;
+    }
+
+    void* view = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+
+    if (view == NULL)
+    {
+        CloseHandle(m);
+        CloseHandle(f);
+        return false;
+    }
+
+    file = f;
+    mapping = m;
+    data = static_cast<const char*>(view);
+    size = static_cast<size_t>(file_size.QuadPart);
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data != nullptr)
+    {
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+        CloseHandle(file);
+    }
+
+    data = nullptr;
+    size = 0;
+    file = nullptr;
+    mapping = nullptr;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& path)
+{
+    Close();
+
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* view = mmap(
+        nullptr,
+        static_cast<size_t>(info.st_size),
+        PROT_READ,
+        MAP_PRIVATE,
+        fd,
+        0);
+
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+
+    if (view == MAP_FAILED)
+    {
+        return false;
+    }
+
+    data = static_cast<const char*>(view);
+    size = static_cast<size_t>(info.st_size);
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data != nullptr)
+    {
+        munmap(const_cast<char*>(data), size);
+    }
+
+    data = nullptr;
+    size = 0;
+}
+
+#endif
+
+const char* MappedFile::Data() const
+{
+    return data;
+}
+
+size_t MappedFile::Size() const
+{
+    return size;
+}
+
+bool TrackView::Open(const char* file_data, size_t file_size)
+{
+    data = nullptr;
+    size = 0;
+    header = nullptr;
+    chunks = nullptr;
+
+    if (!little_endian() || file_size < sizeof(TrackFileHeader))
+    {
+        return false;
+    }
+
+    const TrackFileHeader* h =
+        reinterpret_cast<const TrackFileHeader*>(file_data);
+
+    if (memcmp(h->magic, track_magic, sizeof(track_magic)) != 0 ||
+        h->version != track_version)
+    {
+        return false;
+    }
+
+    size_t table_size = h->chunk_count * sizeof(TrackChunk);
+
+    if (h->chunk_count > (file_size - sizeof(TrackFileHeader)) / sizeof(TrackChunk))
+    {
+        return false;
+    }
+
+    const TrackChunk* table = reinterpret_cast<const TrackChunk*>(
+        file_data + sizeof(TrackFileHeader));
+
+    if (crc32(table, table_size) != h->table_crc)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < h->chunk_count; i++)
+    {
+        const TrackChunk& chunk = table[i];
+
+        if (chunk.offset % track_alignment != 0 ||
+            chunk.offset > file_size ||
+            chunk.size > file_size - chunk.offset)
+        {
+            return false;
+        }
+    }
+
+    // the node count sizes every other chunk, and is only trusted once
+    // the points chunk holds exactly that many
+    const TrackChunk* points = nullptr;
+
+    for (uint32_t i = 0; i < h->chunk_count; i++)
+    {
+        if (table[i].id == CHUNK_POINTS)
+        {
+            points = &table[i];
+        }
+    }
+
+    if (points == nullptr ||
+        h->node_count > points->size / sizeof(vec3) ||
+        h->node_count * sizeof(vec3) != points->size)
+    {
+        return false;
+    }
+
+    data = file_data;
+    size = file_size;
+    header = h;
+    chunks = table;
+
+    return true;
+}
+
+uint64_t TrackView::NodeCount() const
+{
+    return header != nullptr ? header->node_count : 0;
+}
+
+uint32_t TrackView::TableCrc() const
+{
+    return header != nullptr ? header->table_crc : 0;
+}
+
+const TrackChunk* TrackView::Find(uint32_t id) const
+{
+    for (uint32_t i = 0; header != nullptr && i < header->chunk_count; i++)
+    {
+        if (chunks[i].id == id)
+        {
+            return &chunks[i];
+        }
+    }
+
+    return nullptr;
+}
+
+bool TrackView::Verify(const TrackChunk& chunk) const
+{
+    return crc32(data + chunk.offset, static_cast<size_t>(chunk.size)) == chunk.crc;
+}
+
+bool TrackView::Verify(uint32_t id) const
+{
+    const TrackChunk* chunk = Find(id);
+    return chunk != nullptr && Verify(*chunk);
+}
+
+// one array of the file, gathered a piece at a time from each chunk of
+// nodes so the whole array is never copied at once
+struct ChunkSource
+{
+    uint32_t id;
+    uint32_t element_size;
+    void (*gather)(const SplineNodes& nodes, size_t chunk, std::vector<char>& piece);
+};
+
+template <typename T>
+static void append(std::vector<char>& piece, const T* data, size_t count)
+{
+    const char* bytes = reinterpret_cast<const char*>(data);
+    piece.insert(piece.end(), bytes, bytes + count * sizeof(T));
+}
+
+template <vec3 SplineNode::*Field>
+static void gather_nodes(const SplineNodes& nodes, size_t c, std::vector<char>& piece)
+{
+    const SplineNodes::Chunk& chunk = *nodes.Chunks()[c];
+
+    for (const SplineNode& node : chunk.nodes)
+    {
+        append(piece, &(node.*Field), 1);
+    }
+}
+
+static void gather_lengths(const SplineNodes& nodes, size_t c, std::vector<char>& piece)
+{
+    const SplineNodes::Chunk& chunk = *nodes.Chunks()[c];
+    append(piece, chunk.lengths.data(), chunk.lengths.size());
+}
+
+static void gather_arc_lengths(const SplineNodes& nodes, size_t c, std::vector<char>& piece)
+{
+    const SplineNodes::Chunk& chunk = *nodes.Chunks()[c];
+    append(piece, chunk.arc_lengths.data(), chunk.arc_lengths.size());
+}
+
+static void gather_offsets(const SplineNodes& nodes, size_t c, std::vector<char>& piece)
+{
+    // chunks keep offsets from their own start, the file has them from
+    // the start of the track with the total length after the last
+    const SplineNodes::Chunk& chunk = *nodes.Chunks()[c];
+    double start = nodes.Start(c);
+
+    for (double offset : chunk.offsets)
+    {
+        double value = start + offset;
+        append(piece, &value, 1);
+    }
+
+    if (c + 1 == nodes.Chunks().size())
+    {
+        double value = start + chunk.length;
+        append(piece, &value, 1);
+    }
+}
+
+uint32_t save_track(std::ostream& os, const Spline& spline, bool baked)
+{
+    ALLOCATION_TAG(AllocationTag::FILE);
+
+    const SplineNodes& nodes = spline.nodes;
+    size_t count = nodes.Size();
+
+    std::vector<ChunkSource> sources =
+    {
+        { CHUNK_POINTS, sizeof(vec3), gather_nodes<&SplineNode::point> },
+        { CHUNK_CONTROLS, sizeof(vec3), gather_nodes<&SplineNode::control> },
+        { CHUNK_NORMALS, sizeof(vec3), gather_nodes<&SplineNode::normal> },
+        { CHUNK_LENGTHS, sizeof(float), gather_lengths }
+    };
+
+    // caches are only written when they match the nodes
+    bool current =
+        spline.dirty_segments.empty() &&
+        spline.dirty_frames.empty() &&
+        !spline.invalid &&
+        spline.count == count;
+
+    if (baked && current && count > 0)
+    {
+        sources.push_back({ CHUNK_OFFSETS, sizeof(double), gather_offsets });
+        sources.push_back({ CHUNK_ARC_LENGTHS, sizeof(float), gather_arc_lengths });
+    }
+
+    TrackFileHeader header = {};
+    memcpy(header.magic, track_magic, sizeof(track_magic));
+    header.version = track_version;
+    header.chunk_count = static_cast<uint32_t>(sources.size());
+    header.node_count = count;
+
+    std::vector<TrackChunk> table(sources.size());
+    std::vector<char> piece;
+
+    size_t offset = align_up(
+        sizeof(TrackFileHeader) + sources.size() * sizeof(TrackChunk));
+
+    // the table comes first, so every array is gathered once for its
+    // crc and size and again to be written
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        TrackChunk& chunk = table[i];
+        chunk = {};
+        chunk.id = sources[i].id;
+        chunk.offset = offset;
+        chunk.element_size = sources[i].element_size;
+
+        for (size_t c = 0; c < nodes.Chunks().size(); c++)
+        {
+            piece.clear();
+            sources[i].gather(nodes, c, piece);
+
+            chunk.crc = crc32(piece.data(), piece.size(), chunk.crc);
+            chunk.size += piece.size();
+        }
+
+        offset = align_up(offset + static_cast<size_t>(chunk.size));
+    }
+
+    header.table_crc = crc32(table.data(), table.size() * sizeof(TrackChunk));
+
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    os.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(TrackChunk));
+
+    const char padding[track_alignment] = {};
+    size_t position = sizeof(header) + table.size() * sizeof(TrackChunk);
+
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        os.write(padding, table[i].offset - position);
+
+        for (size_t c = 0; c < nodes.Chunks().size(); c++)
+        {
+            piece.clear();
+            sources[i].gather(nodes, c, piece);
+            os.write(piece.data(), piece.size());
+        }
+
+        position = static_cast<size_t>(table[i].offset + table[i].size);
+    }
+
+    return header.table_crc;
+}
+
+bool save_track(const std::string& path, const Spline& spline, bool baked)
+{
+    if (!little_endian())
+    {
+        return false;
+    }
+
+    std::ofstream file(
+        path,
+        std::ios::binary);
+
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    save_track(file, spline, baked);
+
+    return static_cast<bool>(file);
+}
+
+bool load_track(const TrackView& view, Spline& spline, bool verify)
+{
+    ALLOCATION_TAG(AllocationTag::FILE);
+
+    size_t count = static_cast<size_t>(view.NodeCount());
+
+    // used in place, pages are only read as the nodes are copied in
+    const vec3* points = view.Get<vec3>(CHUNK_POINTS, count);
+    const vec3* controls = view.Get<vec3>(CHUNK_CONTROLS, count);
+    const vec3* normals = view.Get<vec3>(CHUNK_NORMALS, count);
+
+    if (points == nullptr ||
+        controls == nullptr ||
+        normals == nullptr)
+    {
+        return false;
+    }
+
+    if (verify &&
+        (!view.Verify(CHUNK_POINTS) ||
+         !view.Verify(CHUNK_CONTROLS) ||
+         !view.Verify(CHUNK_NORMALS)))
+    {
+        return false;
+    }
+
+    spline.Assign(points, controls, normals, count);
+
+    // the baked caches are all or nothing, otherwise lengths are rebuilt.
+    // offsets are summed again from the lengths, which is cheap next to
+    // integrating them.
+    const float* lengths = view.Get<float>(CHUNK_LENGTHS, count);
+    const float* arc_lengths = view.Get<float>(CHUNK_ARC_LENGTHS, count, Spline::arc_samples);
+
+    bool baked =
+        lengths != nullptr &&
+        arc_lengths != nullptr &&
+        (!verify || (view.Verify(CHUNK_LENGTHS) && view.Verify(CHUNK_ARC_LENGTHS)));
+
+    if (baked)
+    {
+        spline.Restore(lengths, arc_lengths);
+        return true;
+    }
+
+    spline.Rebuild();
+
+    return true;
+}
+
+bool read_track_v1(
+    std::istream& is,
+    std::vector<vec3>& points,
+    std::vector<vec3>& controls,
+    std::vector<vec3>& normals)
+{
+    ALLOCATION_TAG(AllocationTag::FILE);
+
+    std::vector<float> lengths;
+
+    deserialize(is, points);
+    deserialize(is, controls);
+    deserialize(is, normals);
+    deserialize(is, lengths);
+
+    return
+        is &&
+        controls.size() == points.size() &&
+        normals.size() == points.size();
+}
+
+static bool load_track_v1(std::istream& is, Spline& spline)
+{
+    std::vector<vec3> points, controls, normals;
+
+    if (!read_track_v1(is, points, controls, normals))
+    {
+        return false;
+    }
+
+    spline.Assign(points.data(), controls.data(), normals.data(), points.size());
+    spline.Rebuild();
+
+    return true;
+}
+
+bool load_track(std::istream& is, Spline& spline)
+{
+    ALLOCATION_TAG(AllocationTag::FILE);
+
+    std::istream::pos_type start = is.tellg();
+
+    char magic[sizeof(track_magic)] = {};
+    is.read(magic, sizeof(magic));
+
+    if (!is || memcmp(magic, track_magic, sizeof(track_magic)) != 0)
+    {
+        is.clear();
+        is.seekg(start);
+        return load_track_v1(is, spline);
+    }
+
+    // without a mapping the whole file is read into memory
+    is.seekg(0, std::ios::end);
+    size_t size = static_cast<size_t>(is.tellg() - start);
+    is.seekg(start);
+
+    std::vector<uint64_t> buffer((size + 7) / 8);
+    is.read(reinterpret_cast<char*>(buffer.data()), size);
+
+    TrackView view;
+
+    if (!is || !view.Open(reinterpret_cast<const char*>(buffer.data()), size))
+    {
+        return false;
+    }
+
+    return load_track(view, spline);
+}
+
+bool load_track(const std::string& path, Spline& spline)
+{
+    MappedFile file;
+
+    if (!file.Open(path))
+    {
+        return false;
+    }
+
+    if (file.Size() >= sizeof(track_magic) &&
+        memcmp(file.Data(), track_magic, sizeof(track_magic)) == 0)
+    {
+        TrackView view;
+        return view.Open(file.Data(), file.Size()) && load_track(view, spline);
+    }
+
+    // not a v2 file, import as v1
+    file.Close();
+
+    std::ifstream stream(
+        path,
+        std::ios::binary);
+
+    return stream.is_open() && load_track_v1(stream, spline);
+}
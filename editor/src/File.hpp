@@ -1,7 +1,13 @@
 #pragma once
 
+#include "Math.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
+#include <string>
 #include <vector>
 
 template<typename T>
@@ -17,76 +23,201 @@ std::ostream& serialize(std::ostream& os, std::vector<T> const& v)
     return os;
 }
 
+// bytes left to read in a stream, or SIZE_MAX when it cannot seek
+inline size_t stream_remaining(std::istream& is)
+{
+    std::istream::pos_type at = is.tellg();
+
+    if (at == std::istream::pos_type(-1))
+    {
+        is.clear(is.rdstate() & ~std::ios::failbit);
+        return SIZE_MAX;
+    }
+
+    is.seekg(0, std::ios::end);
+    std::istream::pos_type end = is.tellg();
+    is.seekg(at);
+
+    return end > at ? static_cast<size_t>(end - at) : 0;
+}
+
 template<typename T>
 std::istream& deserialize(std::istream& is, std::vector<T>& v)
 {
     //static_assert(std::is_trivial<T>::value && std::is_standard_layout<T>::value,
     //    "Can only deserialize POD types with this function");
 
-    decltype(v.size()) size;
+    decltype(v.size()) size = 0;
     is.read(reinterpret_cast<char*>(&size), sizeof(size));
-    v.resize(size);
-    is.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(T));
+
+    v.clear();
+
+    // the count comes from the file, so it must fit in what is left of
+    // the stream before anything is allocated for it
+    if (!is || size > stream_remaining(is) / sizeof(T))
+    {
+        is.setstate(std::ios::failbit);
+        return is;
+    }
+
+    // a stream that cannot seek is read in blocks, so memory only grows
+    // with the data that actually arrives
+    const size_t block = (size_t(1) << 16) / sizeof(T) + 1;
+
+    while (v.size() < size && is)
+    {
+        size_t at = v.size();
+        size_t n = std::min(block, size - at);
+
+        v.resize(at + n);
+        is.read(reinterpret_cast<char*>(v.data() + at), n * sizeof(T));
+    }
+
     return is;
 }
 
-#include <windows.h>
-#include <commdlg.h>
-#include <CDERR.H>
+class Spline;
+
+uint32_t crc32(const void* data, size_t size, uint32_t crc = 0);
+
+// v2 track files, little endian: a header, a table of chunks and then the
+// chunk payloads, each starting on a 64 byte boundary so they can be used
+// in place from a mapped file
+static const uint32_t track_version = 2;
+static const size_t track_alignment = 64;
 
-enum class FileDialogType
+// chunk ids, four characters read as a little endian integer
+enum TrackChunkId : uint32_t
 {
-    OPEN,
-    SAVE
+    CHUNK_POINTS = 0x53544e50,      // PNTS
+    CHUNK_CONTROLS = 0x4c525443,    // CTRL
+    CHUNK_NORMALS = 0x4c4d524e,     // NRML
+    CHUNK_LENGTHS = 0x534e454c,     // LENS
+
+    // baked caches, loading skips length integration when the lengths and
+    // arc lengths are present. offsets are written for other readers and
+    // summed again from the lengths on load.
+    CHUNK_OFFSETS = 0x5346464f,     // OFFS
+    CHUNK_ARC_LENGTHS = 0x4c435241  // ARCL
 };
 
-std::string win_file_dialog(FileDialogType type)
+struct TrackFileHeader
 {
-    char filename[MAX_PATH];
-
-    OPENFILENAME ofn;
-    ZeroMemory(&filename, sizeof(filename));
-    ZeroMemory(&ofn, sizeof(ofn));
-    ofn.lStructSize = sizeof(ofn);
-    ofn.hwndOwner = NULL;  // If you have a window to center over, put its HANDLE here
-    ofn.lpstrFilter = "Track Files\0*.bin\0";
-    ofn.lpstrFile = filename;
-    ofn.nMaxFile = MAX_PATH;
-    ofn.lpstrTitle = "Select a File, yo!";
-    ofn.Flags = OFN_DONTADDTORECENT | OFN_FILEMUSTEXIST;
-
-    if (type == FileDialogType::SAVE && GetSaveFileNameA(&ofn))
-    {
-        return std::string(filename);
-    }
-    else if (type == FileDialogType::OPEN && GetOpenFileNameA(&ofn))
-    {
-        return std::string(filename);
-    }
-    else
+    char magic[8];
+    uint32_t version;
+    uint32_t chunk_count;
+    uint64_t node_count;
+
+    // of the chunk table
+    uint32_t table_crc;
+    uint8_t reserved[36];
+};
+
+struct TrackChunk
+{
+    uint32_t id;
+    uint32_t crc;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t element_size;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(TrackFileHeader) == 64, "track header layout");
+static_assert(sizeof(TrackChunk) == 32, "track chunk layout");
+
+// read only view of a whole file mapped into memory, pages are only read
+// from disk when touched
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool Open(const std::string& path);
+    void Close();
+
+    const char* Data() const;
+    size_t Size() const;
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
+
+// chunks of a v2 track file held in memory, only the header and table
+// are checked when opened so payloads are not touched until used. the
+// node count is checked against the points chunk, so it always fits in
+// memory.
+class TrackView
+{
+public:
+    bool Open(const char* data, size_t size);
+
+    uint64_t NodeCount() const;
+    uint32_t TableCrc() const;
+    const TrackChunk* Find(uint32_t id) const;
+
+    // checks the payload of a chunk against its crc, reading every page
+    // of it, false if the chunk is missing
+    bool Verify(const TrackChunk& chunk) const;
+    bool Verify(uint32_t id) const;
+
+    // payload of a chunk as an array used in place, null if missing or
+    // not count groups of per elements of T. the crc is not checked.
+    template <typename T>
+    const T* Get(uint32_t id, size_t count, size_t per = 1) const;
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+
+    const TrackFileHeader* header = nullptr;
+    const TrackChunk* chunks = nullptr;
+};
+
+template <typename T>
+const T* TrackView::Get(uint32_t id, size_t count, size_t per) const
+{
+    const TrackChunk* chunk = Find(id);
+
+    // counts come from the file, so they are checked against the chunk
+    // before anything is multiplied by them
+    if (chunk == nullptr ||
+        chunk->element_size != sizeof(T) ||
+        per == 0 ||
+        count > chunk->size / sizeof(T) / per ||
+        chunk->size != count * per * sizeof(T))
     {
-        // All this stuff below is to tell you exactly how you messed up above.
-        // Once you've got that fixed, you can often (not always!) reduce it to a 'user cancelled' assumption.
-        switch (CommDlgExtendedError())
-        {
-        case CDERR_DIALOGFAILURE: std::cout << "CDERR_DIALOGFAILURE\n";   break;
-        case CDERR_FINDRESFAILURE: std::cout << "CDERR_FINDRESFAILURE\n";  break;
-        case CDERR_INITIALIZATION: std::cout << "CDERR_INITIALIZATION\n";  break;
-        case CDERR_LOADRESFAILURE: std::cout << "CDERR_LOADRESFAILURE\n";  break;
-        case CDERR_LOADSTRFAILURE: std::cout << "CDERR_LOADSTRFAILURE\n";  break;
-        case CDERR_LOCKRESFAILURE: std::cout << "CDERR_LOCKRESFAILURE\n";  break;
-        case CDERR_MEMALLOCFAILURE: std::cout << "CDERR_MEMALLOCFAILURE\n"; break;
-        case CDERR_MEMLOCKFAILURE: std::cout << "CDERR_MEMLOCKFAILURE\n";  break;
-        case CDERR_NOHINSTANCE: std::cout << "CDERR_NOHINSTANCE\n";     break;
-        case CDERR_NOHOOK: std::cout << "CDERR_NOHOOK\n";          break;
-        case CDERR_NOTEMPLATE: std::cout << "CDERR_NOTEMPLATE\n";      break;
-        case CDERR_STRUCTSIZE: std::cout << "CDERR_STRUCTSIZE\n";      break;
-        case FNERR_BUFFERTOOSMALL: std::cout << "FNERR_BUFFERTOOSMALL\n";  break;
-        case FNERR_INVALIDFILENAME: std::cout << "FNERR_INVALIDFILENAME\n"; break;
-        case FNERR_SUBCLASSFAILURE: std::cout << "FNERR_SUBCLASSFAILURE\n"; break;
-        default: std::cout << "You cancelled.\n";
-        }
+        return nullptr;
     }
 
-    return "";
+    return reinterpret_cast<const T*>(data + chunk->offset);
 }
+
+// saves in the v2 format, with the length caches when baked is set, and
+// returns the crc of the chunk table which identifies the file contents
+uint32_t save_track(std::ostream& os, const Spline& spline, bool baked = true);
+bool save_track(const std::string& path, const Spline& spline, bool baked = true);
+
+// loads v2 files, and v1 files which are the four node arrays in a row.
+// a v2 view is read in place and only copied into the spline's nodes,
+// its crcs are checked first when verify is set.
+bool load_track(const TrackView& view, Spline& spline, bool verify = true);
+bool load_track(std::istream& is, Spline& spline);
+bool load_track(const std::string& path, Spline& spline);
+
+// reads only the node arrays of a v1 file, leaving the spline to be
+// built from them by the caller
+bool read_track_v1(
+    std::istream& is,
+    std::vector<vec3>& points,
+    std::vector<vec3>& controls,
+    std::vector<vec3>& normals);
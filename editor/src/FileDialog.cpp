@@ -0,0 +1,76 @@
+#include "FileDialog.hpp"
+
+#include <iostream>
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <commdlg.h>
+#include <CDERR.H>
+
+std::string file_dialog(FileDialogType type)
+{
+    char filename[MAX_PATH];
+
+    OPENFILENAME ofn;
+    ZeroMemory(&filename, sizeof(filename));
+    ZeroMemory(&ofn, sizeof(ofn));
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = NULL;  // If you have a window to center over, put its HANDLE here
+    ofn.lpstrFilter = "Track Files\0*.bin\0";
+    ofn.lpstrFile = filename;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.lpstrTitle = "Select a File, yo!";
+    ofn.Flags = OFN_DONTADDTORECENT | OFN_FILEMUSTEXIST;
+
+    if (type == FileDialogType::SAVE && GetSaveFileNameA(&ofn))
+    {
+        return std::string(filename);
+    }
+    else if (type == FileDialogType::OPEN && GetOpenFileNameA(&ofn))
+    {
+        return std::string(filename);
+    }
+    else
+    {
+        // All this stuff below is to tell you exactly how you messed up above.
+        // Once you've got that fixed, you can often (not always!) reduce it to a 'user cancelled' assumption.
+        switch (CommDlgExtendedError())
+        {
+        case CDERR_DIALOGFAILURE: std::cout << "CDERR_DIALOGFAILURE\n";   break;
+        case CDERR_FINDRESFAILURE: std::cout << "CDERR_FINDRESFAILURE\n";  break;
+        case CDERR_INITIALIZATION: std::cout << "CDERR_INITIALIZATION\n";  break;
+        case CDERR_LOADRESFAILURE: std::cout << "CDERR_LOADRESFAILURE\n";  break;
+        case CDERR_LOADSTRFAILURE: std::cout << "CDERR_LOADSTRFAILURE\n";  break;
+        case CDERR_LOCKRESFAILURE: std::cout << "CDERR_LOCKRESFAILURE\n";  break;
+        case CDERR_MEMALLOCFAILURE: std::cout << "CDERR_MEMALLOCFAILURE\n"; break;
+        case CDERR_MEMLOCKFAILURE: std::cout << "CDERR_MEMLOCKFAILURE\n";  break;
+        case CDERR_NOHINSTANCE: std::cout << "CDERR_NOHINSTANCE\n";     break;
+        case CDERR_NOHOOK: std::cout << "CDERR_NOHOOK\n";          break;
+        case CDERR_NOTEMPLATE: std::cout << "CDERR_NOTEMPLATE\n";      break;
+        case CDERR_STRUCTSIZE: std::cout << "CDERR_STRUCTSIZE\n";      break;
+        case FNERR_BUFFERTOOSMALL: std::cout << "FNERR_BUFFERTOOSMALL\n";  break;
+        case FNERR_INVALIDFILENAME: std::cout << "FNERR_INVALIDFILENAME\n"; break;
+        case FNERR_SUBCLASSFAILURE: std::cout << "FNERR_SUBCLASSFAILURE\n"; break;
+        default: std::cout << "You cancelled.\n";
+        }
+    }
+
+    return "";
+}
+
+#else
+
+// no native dialog, the path is read from the terminal instead
+std::string file_dialog(FileDialogType type)
+{
+    std::cout << (type == FileDialogType::SAVE ? "Save" : "Open")
+        << " track: " << std::flush;
+
+    std::string filename;
+    std::getline(std::cin, filename);
+
+    return filename;
+}
+
+#endif
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+enum class FileDialogType
+{
+    OPEN,
+    SAVE
+};
+
+// asks the user for a track path, empty if cancelled
+std::string file_dialog(FileDialogType type);
@@ -0,0 +1,96 @@
+#include "FrameArena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+static size_t align_offset(const char* base, size_t offset, size_t alignment)
+{
+    uintptr_t address = reinterpret_cast<uintptr_t>(base) + offset;
+    uintptr_t aligned = (address + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+
+    return offset + static_cast<size_t>(aligned - address);
+}
+
+FrameArena::FrameArena(size_t capacity) :
+    block(new char[capacity]),
+    capacity(capacity)
+{
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+    size_t offset = align_offset(block.get(), used, alignment);
+
+    if (offset + size <= capacity)
+    {
+        used = offset + size;
+        return block.get() + offset;
+    }
+
+    offset = overflow.empty() ?
+        0 : align_offset(overflow.back().get(), overflow_used, alignment);
+
+    if (overflow.empty() || offset + size > overflow_capacity)
+    {
+        // padded so the start can always be aligned
+        overflow_capacity = std::max(size + alignment, capacity);
+        overflow.emplace_back(new char[overflow_capacity]);
+        offset = align_offset(overflow.back().get(), 0, alignment);
+    }
+
+    overflow_used = offset + size;
+    overflow_total += size;
+
+    return overflow.back().get() + offset;
+}
+
+void FrameArena::Reset()
+{
+    last_frame_used = Used();
+    high_water = std::max(high_water, last_frame_used);
+
+    // one block large enough for the busiest frame so far
+    if (!overflow.empty())
+    {
+        overflow.clear();
+
+        while (capacity < high_water)
+        {
+            capacity = capacity > 0 ? capacity * 2 : 4096;
+        }
+
+        block.reset(new char[capacity]);
+    }
+
+    used = 0;
+    overflow_capacity = 0;
+    overflow_used = 0;
+    overflow_total = 0;
+}
+
+size_t FrameArena::Used() const
+{
+    return used + overflow_total;
+}
+
+size_t FrameArena::LastFrameUsed() const
+{
+    return last_frame_used;
+}
+
+size_t FrameArena::HighWater() const
+{
+    return high_water;
+}
+
+size_t FrameArena::Capacity() const
+{
+    return capacity;
+}
+
+FrameArena& FrameArena::Frame()
+{
+    // never freed, so containers destroyed at exit may still point at it
+    static FrameArena* arena = new FrameArena();
+    return *arena;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// bump allocator for data that only lives until the end of a frame.
+// allocating is a pointer bump and freeing does nothing, all of it is
+// released at once by Reset. requests that do not fit go to extra blocks
+// from the heap, and the next Reset grows the main block to the most ever
+// used so a steady frame only ever touches one block.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t capacity = 1 << 20);
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment);
+
+    // invalidates everything allocated since the last reset
+    void Reset();
+
+    // bytes handed out since the last reset, and in the last whole frame
+    size_t Used() const;
+    size_t LastFrameUsed() const;
+
+    // most bytes any frame has used, and the size of the main block
+    size_t HighWater() const;
+    size_t Capacity() const;
+
+    // the main thread's arena, reset by System::FrameUpdate. nothing
+    // allocated from it may be kept past the end of the frame.
+    static FrameArena& Frame();
+
+private:
+    std::unique_ptr<char[]> block;
+    size_t capacity = 0;
+    size_t used = 0;
+
+    std::vector<std::unique_ptr<char[]>> overflow;
+    size_t overflow_capacity = 0;
+    size_t overflow_used = 0;
+    size_t overflow_total = 0;
+
+    size_t last_frame_used = 0;
+    size_t high_water = 0;
+};
+
+// std allocator over a frame arena, the frame arena unless given another
+template <typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+
+    FrameArena* arena;
+
+    ArenaAllocator() :
+        arena(&FrameArena::Frame())
+    {
+    }
+
+    ArenaAllocator(FrameArena& arena) :
+        arena(&arena)
+    {
+    }
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) :
+        arena(other.arena)
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(arena->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t)
+    {
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return a.arena != b.arena;
+}
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,427 @@
+#include "History.hpp"
+#include "Allocation.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <unordered_set>
+
+static size_t changes_bytes(const std::vector<SplineNodeChange>& changes)
+{
+    return sizeof(changes) + changes.capacity() * sizeof(SplineNodeChange);
+}
+
+// the set edits taking a node from one value to another
+static void set_edits(
+    size_t index,
+    const SplineNode& from,
+    const SplineNode& to,
+    std::vector<SplineEdit>& edits)
+{
+    if (from.point != to.point)
+    {
+        edits.push_back({ SplineEditType::SET_POINT, index, to.point });
+    }
+    if (from.control != to.control)
+    {
+        edits.push_back({ SplineEditType::SET_CONTROL, index, to.control });
+    }
+    if (from.normal != to.normal)
+    {
+        edits.push_back({ SplineEditType::SET_NORMAL, index, to.normal });
+    }
+}
+
+static void insert_edits(
+    size_t index,
+    const SplineNode& node,
+    std::vector<SplineEdit>& edits)
+{
+    edits.push_back({ SplineEditType::INSERT_POINT_BEFORE, index, node.point });
+    edits.push_back({ SplineEditType::SET_CONTROL, index, node.control });
+    edits.push_back({ SplineEditType::SET_NORMAL, index, node.normal });
+}
+
+void EditHistory::Attach(Spline& target)
+{
+    spline = &target;
+
+    spline->AddNodeListener([this](const SplineNodeChange& change)
+    {
+        Record(change);
+    });
+
+    // every edit outside a group is an entry of its own
+    spline->AddListener([this](const SplineEdit&)
+    {
+        if (!applying && group_depth == 0)
+        {
+            Commit();
+        }
+    });
+
+    Clear();
+}
+
+void EditHistory::Clear()
+{
+    entries.clear();
+    checkpoints.clear();
+    pending.clear();
+
+    first = 0;
+    position = 0;
+    group_depth = 0;
+    entry_bytes = 0;
+    checkpoint_bytes = 0;
+
+    if (spline != nullptr)
+    {
+        AddCheckpoint();
+    }
+}
+
+void EditHistory::Begin()
+{
+    group_depth++;
+}
+
+void EditHistory::End()
+{
+    if (group_depth > 0 && --group_depth == 0)
+    {
+        Commit();
+    }
+}
+
+void EditHistory::Undo()
+{
+    if (position > first)
+    {
+        Jump(position - 1);
+    }
+}
+
+void EditHistory::Redo()
+{
+    Jump(position + 1);
+}
+
+void EditHistory::Jump(size_t target)
+{
+    if (spline == nullptr || group_depth > 0)
+    {
+        return;
+    }
+
+    target = std::max(first, std::min(target, Last()));
+
+    if (target == position)
+    {
+        return;
+    }
+
+    PROFILE_ZONE("EditHistory::Jump");
+    ALLOCATION_TAG(AllocationTag::HISTORY);
+
+    // a checkpoint is worth restoring when finding its nodes again and
+    // replaying from it costs less than replaying from here. restoring
+    // rebuilds no segments, only the location of every node, and about a
+    // thousand of those cost as much as replaying one change.
+    const Checkpoint* restore = nullptr;
+    size_t best = Cost(position, target);
+
+    for (const Checkpoint& checkpoint : checkpoints)
+    {
+        size_t cost = spline->count / 1024 + 1 + Cost(checkpoint.position, target);
+
+        if (cost < best)
+        {
+            best = cost;
+            restore = &checkpoint;
+        }
+    }
+
+    std::vector<SplineEdit> edits;
+    Edits(position, target, edits);
+
+    applying = true;
+
+    if (restore != nullptr)
+    {
+        std::vector<SplineEdit> replay;
+        Edits(restore->position, target, replay);
+
+        std::vector<SplineListener> listeners;
+        listeners.swap(spline->listeners);
+
+        spline->RestoreNodes(restore->chunks);
+        spline->BeginEdit();
+
+        for (const SplineEdit& edit : replay)
+        {
+            spline->Apply(edit);
+        }
+
+        spline->EndEdit();
+        listeners.swap(spline->listeners);
+
+        // listeners hear the edits stepping back one entry at a time
+        // would have made, so the journal replays to the same state
+        for (const SplineEdit& edit : edits)
+        {
+            spline->Notify(edit);
+        }
+    }
+    else
+    {
+        spline->BeginEdit();
+
+        for (const SplineEdit& edit : edits)
+        {
+            spline->Apply(edit);
+        }
+
+        spline->EndEdit();
+    }
+
+    applying = false;
+    position = target;
+}
+
+size_t EditHistory::Position() const
+{
+    return position;
+}
+
+size_t EditHistory::First() const
+{
+    return first;
+}
+
+size_t EditHistory::Last() const
+{
+    return first + entries.size();
+}
+
+size_t EditHistory::Entries() const
+{
+    return entries.size();
+}
+
+size_t EditHistory::Checkpoints() const
+{
+    return checkpoints.size();
+}
+
+size_t EditHistory::Memory() const
+{
+    size_t copies = spline != nullptr ? spline->nodes.CopiedBytes() : 0;
+    size_t copied = copies > measured_copies ? copies - measured_copies : 0;
+
+    return entry_bytes + checkpoint_bytes + copied;
+}
+
+void EditHistory::Record(const SplineNodeChange& change)
+{
+    if (applying)
+    {
+        return;
+    }
+
+    if (change.type == SplineNodeChangeType::RESET)
+    {
+        Clear();
+        return;
+    }
+
+    ALLOCATION_TAG(AllocationTag::HISTORY);
+
+    // a drag writes the same node over and over and only its first and
+    // last value matter, and a node written straight after being inserted
+    // can be inserted with its final value
+    if (change.type == SplineNodeChangeType::SET && !pending.empty())
+    {
+        SplineNodeChange& last = pending.back();
+
+        if (last.index == change.index &&
+            (last.type == SplineNodeChangeType::SET ||
+             last.type == SplineNodeChangeType::INSERT))
+        {
+            last.after = change.after;
+            return;
+        }
+    }
+
+    pending.push_back(change);
+}
+
+void EditHistory::Commit()
+{
+    if (pending.empty())
+    {
+        return;
+    }
+
+    ALLOCATION_TAG(AllocationTag::HISTORY);
+
+    // a new entry ends everything that could have been redone
+    while (Last() > position)
+    {
+        entry_bytes -= changes_bytes(entries.back().changes);
+        entries.pop_back();
+    }
+
+    bool dropped = false;
+
+    while (!checkpoints.empty() && checkpoints.back().position > position)
+    {
+        checkpoints.pop_back();
+        dropped = true;
+    }
+
+    // copied to size, pending keeps its capacity for the next entry
+    entries.emplace_back();
+    entries.back().changes.assign(pending.begin(), pending.end());
+    entry_bytes += changes_bytes(entries.back().changes);
+
+    pending.clear();
+    position++;
+
+    if (checkpoints.empty() ||
+        position - checkpoints.back().position >= checkpoint_interval)
+    {
+        AddCheckpoint();
+    }
+    else if (dropped)
+    {
+        MeasureCheckpoints();
+    }
+
+    Trim();
+}
+
+void EditHistory::AddCheckpoint()
+{
+    // shares every chunk with the spline, they are only copied as the
+    // spline writes to them. their segments are brought up to date first
+    // so restoring them rebuilds nothing.
+    spline->Update();
+    checkpoints.push_back({ position, spline->nodes.Chunks() });
+
+    MeasureCheckpoints();
+}
+
+void EditHistory::MeasureCheckpoints()
+{
+    ALLOCATION_TAG(AllocationTag::HISTORY);
+
+    // chunks the spline still holds cost nothing more, and a chunk held
+    // by several checkpoints is counted once
+    std::unordered_set<const SplineNodes::Chunk*> counted;
+
+    for (const auto& chunk : spline->nodes.Chunks())
+    {
+        counted.insert(chunk.get());
+    }
+
+    checkpoint_bytes = 0;
+
+    for (const Checkpoint& checkpoint : checkpoints)
+    {
+        checkpoint_bytes += checkpoint.chunks.capacity() * sizeof(checkpoint.chunks[0]);
+
+        for (const auto& chunk : checkpoint.chunks)
+        {
+            if (counted.insert(chunk.get()).second)
+            {
+                checkpoint_bytes += chunk->Bytes();
+            }
+        }
+    }
+
+    measured_copies = spline->nodes.CopiedBytes();
+}
+
+void EditHistory::Trim()
+{
+    // oldest entries first, with any checkpoint that falls out of reach
+    while (Memory() > memory_cap && first < position)
+    {
+        entry_bytes -= changes_bytes(entries.front().changes);
+        entries.pop_front();
+        first++;
+
+        if (!checkpoints.empty() && checkpoints.front().position < first)
+        {
+            checkpoints.erase(checkpoints.begin());
+            MeasureCheckpoints();
+        }
+    }
+}
+
+void EditHistory::Edits(
+    size_t from,
+    size_t to,
+    std::vector<SplineEdit>& edits) const
+{
+    for (size_t p = from; p < to; p++)
+    {
+        for (const SplineNodeChange& change : entries[p - first].changes)
+        {
+            switch (change.type)
+            {
+                case SplineNodeChangeType::SET:
+                    set_edits(change.index, change.before, change.after, edits);
+                    break;
+                case SplineNodeChangeType::INSERT:
+                    insert_edits(change.index, change.after, edits);
+                    break;
+                case SplineNodeChangeType::ERASE:
+                    edits.push_back({ SplineEditType::DELETE_POINT, change.index, change.before.point });
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    // going back undoes each change in reverse
+    for (size_t p = from; p > to; p--)
+    {
+        const std::vector<SplineNodeChange>& changes = entries[p - 1 - first].changes;
+
+        for (size_t k = changes.size(); k > 0; k--)
+        {
+            const SplineNodeChange& change = changes[k - 1];
+
+            switch (change.type)
+            {
+                case SplineNodeChangeType::SET:
+                    set_edits(change.index, change.after, change.before, edits);
+                    break;
+                case SplineNodeChangeType::INSERT:
+                    edits.push_back({ SplineEditType::DELETE_POINT, change.index, change.after.point });
+                    break;
+                case SplineNodeChangeType::ERASE:
+                    insert_edits(change.index, change.before, edits);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+size_t EditHistory::Cost(size_t from, size_t to) const
+{
+    // every change writes one chunk and rebuilds the segments either side,
+    // whether it sets, inserts or erases a node
+    size_t cost = 0;
+
+    for (size_t p = std::min(from, to); p < std::max(from, to); p++)
+    {
+        cost += entries[p - first].changes.size();
+    }
+
+    return cost;
+}
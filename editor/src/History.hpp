@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Spline.hpp"
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// undo and redo for one spline. an entry keeps only the nodes its edits
+// changed, before and after, and a group such as a whole drag becomes a
+// single entry with one change per node. every few entries the node
+// chunks are kept as a checkpoint sharing every chunk not written since,
+// so a jump across many entries can restore the nearest one and replay
+// from there. entries and checkpoints are dropped oldest first to stay
+// under the memory cap.
+//
+// undoing goes through the journaled spline edits, so the autosave
+// journal follows it like any other edit.
+class EditHistory
+{
+public:
+    // bytes kept for entries and checkpoints
+    size_t memory_cap = size_t(256) << 20;
+
+    // entries between checkpoints
+    size_t checkpoint_interval = 64;
+
+    EditHistory() = default;
+    EditHistory(const EditHistory&) = delete;
+    EditHistory& operator=(const EditHistory&) = delete;
+
+    // records every edit made to spline from now on
+    void Attach(Spline& spline);
+
+    // forgets everything, the current state becomes the oldest
+    void Clear();
+
+    // edits until the matching End become one entry
+    void Begin();
+    void End();
+
+    void Undo();
+    void Redo();
+
+    // moves to the state after the given number of entries, as far as
+    // First and Last allow
+    void Jump(size_t position);
+
+    size_t Position() const;
+    size_t First() const;
+    size_t Last() const;
+
+    size_t Entries() const;
+    size_t Checkpoints() const;
+
+    // bytes held by entries and by chunks only checkpoints still hold
+    size_t Memory() const;
+
+private:
+    using Chunks = std::vector<std::shared_ptr<const SplineNodes::Chunk>>;
+
+    struct Entry
+    {
+        std::vector<SplineNodeChange> changes;
+    };
+
+    struct Checkpoint
+    {
+        size_t position;
+        Chunks chunks;
+    };
+
+    Spline* spline = nullptr;
+
+    std::deque<Entry> entries;
+    std::vector<Checkpoint> checkpoints;
+
+    // changes of the entry being recorded
+    std::vector<SplineNodeChange> pending;
+
+    // position of the oldest entry, and the state the spline is in
+    size_t first = 0;
+    size_t position = 0;
+
+    size_t group_depth = 0;
+    bool applying = false;
+
+    size_t entry_bytes = 0;
+
+    // measured when checkpoints are added or dropped, with chunk copies
+    // made since counted as they happen
+    size_t checkpoint_bytes = 0;
+    size_t measured_copies = 0;
+
+    void Record(const SplineNodeChange& change);
+    void Commit();
+    void AddCheckpoint();
+    void MeasureCheckpoints();
+    void Trim();
+
+    // edits taking the spline from one position to another, and a rough
+    // cost of applying them in node changes
+    void Edits(size_t from, size_t to, std::vector<SplineEdit>& edits) const;
+    size_t Cost(size_t from, size_t to) const;
+};
@@ -0,0 +1,336 @@
+#include "Jobs.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+// queue of the worker running on this thread, if any
+static thread_local JobSystem* current_system = nullptr;
+static thread_local size_t current_queue = 0;
+
+// group of the job running on this thread, if any
+static thread_local JobCounter* current_group = nullptr;
+
+JobSystem::JobSystem(size_t thread_count)
+{
+    if (thread_count == 0)
+    {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    size_t worker_count = thread_count - 1;
+
+    for (size_t i = 0; i <= worker_count; i++)
+    {
+        queues.emplace_back(new Queue());
+    }
+
+    for (size_t i = 0; i < worker_count; i++)
+    {
+        workers.emplace_back([this, i]()
+        {
+            WorkerLoop(i);
+        });
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stop = true;
+    }
+
+    sleep.notify_all();
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+size_t JobSystem::ThreadCount() const
+{
+    return workers.size() + 1;
+}
+
+JobSystem& JobSystem::Default()
+{
+    static JobSystem jobs([]()
+    {
+        const char* threads = getenv("SUPERROCKET_THREADS");
+        return threads != nullptr ? strtoul(threads, nullptr, 10) : 0;
+    }());
+
+    return jobs;
+}
+
+void JobSystem::Submit(std::function<void()> function, JobCounter& counter)
+{
+    counter++;
+
+    Job job;
+    job.function = std::move(function);
+    job.counter = &counter;
+    job.group = current_group != nullptr ? current_group : &counter;
+
+    Push(std::move(job));
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+    const JobCounter* group = current_group != nullptr ? current_group : &counter;
+    Job job;
+
+    while (true)
+    {
+        // read before looking, so a push after a failed Pop still wakes us
+        size_t seen = pushes;
+
+        if (counter == 0)
+        {
+            return;
+        }
+
+        if (Pop(job, group))
+        {
+            Execute(job);
+            continue;
+        }
+
+        // the rest of the group is running on other threads
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+
+        waiting++;
+
+        waiters.wait(lock, [&]()
+        {
+            return counter == 0 || pushes != seen;
+        });
+
+        waiting--;
+    }
+}
+
+void JobSystem::ParallelFor(
+    size_t count,
+    size_t grain,
+    const std::function<void(size_t, size_t)>& function)
+{
+    grain = std::max<size_t>(1, grain);
+    size_t blocks = (count + grain - 1) / grain;
+
+    if (blocks <= 1 || workers.empty())
+    {
+        for (size_t first = 0; first < count; first += grain)
+        {
+            function(first, std::min(first + grain, count));
+        }
+
+        return;
+    }
+
+    JobCounter counter(0);
+
+    // the caller takes the first block itself
+    for (size_t b = 1; b < blocks; b++)
+    {
+        size_t first = b * grain;
+        size_t last = std::min(first + grain, count);
+
+        Submit([&function, first, last]()
+        {
+            function(first, last);
+        }, counter);
+    }
+
+    function(0, std::min(grain, count));
+
+    Wait(counter);
+}
+
+void JobSystem::Push(Job job)
+{
+    size_t index = current_system == this ? current_queue : queues.size() - 1;
+
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->jobs.push_back(std::move(job));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        queued++;
+        pushes++;
+    }
+
+    sleep.notify_one();
+
+    if (waiting > 0)
+    {
+        waiters.notify_all();
+    }
+}
+
+bool JobSystem::Pop(Job& job, const JobCounter* group)
+{
+    size_t count = queues.size();
+    size_t own = current_system == this ? current_queue : count - 1;
+
+    // newest from our own queue, oldest from anyone else's
+    for (size_t k = 0; k < count; k++)
+    {
+        size_t index = (own + k) % count;
+        Queue& queue = *queues[index];
+
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        auto found = queue.jobs.end();
+
+        if (group == nullptr)
+        {
+            if (!queue.jobs.empty())
+            {
+                found = k == 0 ? queue.jobs.end() - 1 : queue.jobs.begin();
+            }
+        }
+        else if (k == 0)
+        {
+            auto last = std::find_if(queue.jobs.rbegin(), queue.jobs.rend(), [group](const Job& j)
+            {
+                return j.group == group;
+            });
+
+            found = last != queue.jobs.rend() ? last.base() - 1 : queue.jobs.end();
+        }
+        else
+        {
+            found = std::find_if(queue.jobs.begin(), queue.jobs.end(), [group](const Job& j)
+            {
+                return j.group == group;
+            });
+        }
+
+        if (found == queue.jobs.end())
+        {
+            continue;
+        }
+
+        job = std::move(*found);
+        queue.jobs.erase(found);
+
+        queued--;
+
+        return true;
+    }
+
+    return false;
+}
+
+void JobSystem::Execute(Job& job)
+{
+    JobCounter* outer = current_group;
+    current_group = job.group;
+
+    job.function();
+    job.function = nullptr;
+
+    current_group = outer;
+
+    if (--(*job.counter) == 0 && waiting > 0)
+    {
+        // taking the lock orders this after a waiter's last check
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+        }
+
+        waiters.notify_all();
+    }
+}
+
+void JobSystem::WorkerLoop(size_t index)
+{
+    current_system = this;
+    current_queue = index;
+
+    Job job;
+
+    while (true)
+    {
+        if (Pop(job))
+        {
+            Execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+
+        sleep.wait(lock, [this]()
+        {
+            return stop || queued > 0;
+        });
+
+        if (stop && queued == 0)
+        {
+            return;
+        }
+    }
+}
+
+size_t TaskGraph::Add(
+    std::function<void()> function,
+    std::vector<size_t> dependencies)
+{
+    size_t id = tasks.size();
+
+    for (size_t d : dependencies)
+    {
+        tasks[d].dependents.push_back(id);
+    }
+
+    Task task;
+    task.function = std::move(function);
+    task.dependency_count = dependencies.size();
+    task.remaining.reset(new std::atomic<size_t>(0));
+
+    tasks.push_back(std::move(task));
+
+    return id;
+}
+
+void TaskGraph::Run(JobSystem& jobs)
+{
+    for (auto& task : tasks)
+    {
+        *task.remaining = task.dependency_count;
+    }
+
+    JobCounter counter(0);
+
+    for (size_t i = 0; i < tasks.size(); i++)
+    {
+        if (tasks[i].dependency_count == 0)
+        {
+            Schedule(jobs, i, counter);
+        }
+    }
+
+    jobs.Wait(counter);
+}
+
+void TaskGraph::Schedule(JobSystem& jobs, size_t task, JobCounter& counter)
+{
+    // dependents are submitted before this job counts as done, so the
+    // counter cannot reach zero while tasks are still to run
+    jobs.Submit([this, &jobs, task, &counter]()
+    {
+        tasks[task].function();
+
+        for (size_t d : tasks[task].dependents)
+        {
+            if (--*tasks[d].remaining == 0)
+            {
+                Schedule(jobs, d, counter);
+            }
+        }
+    }, counter);
+}
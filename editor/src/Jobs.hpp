@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// counts the jobs of one submission still to finish
+using JobCounter = std::atomic<size_t>;
+
+struct Job
+{
+    std::function<void()> function;
+    JobCounter* counter = nullptr;
+
+    // counter of the outermost Wait the job belongs to, shared by
+    // everything submitted from inside it
+    JobCounter* group = nullptr;
+};
+
+// fixed pool of worker threads, each with its own queue that other
+// threads steal from when theirs runs dry. a thread waiting on a counter
+// runs queued jobs of its own group meanwhile, so jobs may submit and wait
+// on further jobs, and sleeps when none of them are left to start. a
+// group is everything submitted for one caller outside the pool, so a
+// thread never picks up another caller's long jobs while it waits.
+// results only depend on how work is split, never on which thread ran it.
+class JobSystem
+{
+public:
+    // zero picks one thread per core, counting the caller
+    explicit JobSystem(size_t thread_count = 0);
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+    ~JobSystem();
+
+    // workers plus the calling thread
+    size_t ThreadCount() const;
+
+    void Submit(std::function<void()> function, JobCounter& counter);
+    void Wait(JobCounter& counter);
+
+    // calls function(first, last) over blocks of at most grain items
+    // covering [0, count), returning once all have run
+    void ParallelFor(
+        size_t count,
+        size_t grain,
+        const std::function<void(size_t, size_t)>& function);
+
+    // shared pool, sized by SUPERROCKET_THREADS when set
+    static JobSystem& Default();
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    // one per worker, and a last one for threads outside the pool
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleep_mutex;
+    std::condition_variable sleep;
+    std::atomic<size_t> queued { 0 };
+    bool stop = false;
+
+    // threads blocked in Wait, woken by each push and by any counter
+    // reaching zero
+    std::condition_variable waiters;
+    std::atomic<size_t> waiting { 0 };
+    std::atomic<size_t> pushes { 0 };
+
+    void Push(Job job);
+
+    // any job, or with a group only the jobs in it
+    bool Pop(Job& job, const JobCounter* group = nullptr);
+    void Execute(Job& job);
+    void WorkerLoop(size_t index);
+};
+
+// jobs with dependencies, each runs once everything it depends on is done
+class TaskGraph
+{
+public:
+    // returns the id later tasks use to depend on this one
+    size_t Add(
+        std::function<void()> function,
+        std::vector<size_t> dependencies = {});
+
+    void Run(JobSystem& jobs);
+
+private:
+    struct Task
+    {
+        std::function<void()> function;
+        std::vector<size_t> dependents;
+        size_t dependency_count = 0;
+        std::unique_ptr<std::atomic<size_t>> remaining;
+    };
+
+    std::vector<Task> tasks;
+
+    void Schedule(JobSystem& jobs, size_t task, JobCounter& counter);
+};
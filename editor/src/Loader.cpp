@@ -0,0 +1,233 @@
+#include "Loader.hpp"
+
+#include "Allocation.hpp"
+#include "File.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+TrackLoader::~TrackLoader()
+{
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+}
+
+void TrackLoader::Start(const std::string& path)
+{
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+
+    loaded = Spline();
+    preview.clear();
+    preview_ready = false;
+    segments_done = 0;
+    segments_total = 0;
+    state = static_cast<int>(LoadState::LOADING);
+
+    worker = std::thread([this, path]()
+    {
+        Load(path);
+    });
+}
+
+LoadState TrackLoader::State() const
+{
+    return static_cast<LoadState>(state.load());
+}
+
+float TrackLoader::Progress() const
+{
+    size_t total = segments_total;
+    return total > 0 ? static_cast<float>(segments_done) / total : 0.0f;
+}
+
+bool TrackLoader::GetPreview(std::vector<vec3>& points)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (preview_ready)
+    {
+        points = preview;
+    }
+
+    return preview_ready;
+}
+
+bool TrackLoader::Take(Spline& target)
+{
+    if (State() != LoadState::DONE)
+    {
+        return false;
+    }
+
+    worker.join();
+
+    std::vector<SplineListener> listeners;
+    std::vector<SplineNodeListener> node_listeners;
+    listeners.swap(target.listeners);
+    node_listeners.swap(target.node_listeners);
+    uint64_t revision = target.revision;
+
+    target = std::move(loaded);
+    target.listeners.swap(listeners);
+    target.node_listeners.swap(node_listeners);
+
+    // derived data keyed on the revision must not match the old spline
+    target.revision = std::max(target.revision, revision) + 1;
+
+    loaded = Spline();
+    state = static_cast<int>(LoadState::IDLE);
+
+    return true;
+}
+
+void TrackLoader::SetPreview(const vec3* points, size_t count)
+{
+    size_t step = std::max<size_t>(1, (count + preview_size - 1) / preview_size);
+
+    std::vector<vec3> decimated;
+    decimated.reserve(count / step + 1);
+
+    for (size_t i = 0; i < count; i += step)
+    {
+        decimated.push_back(points[i]);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    preview.swap(decimated);
+    preview_ready = true;
+}
+
+void TrackLoader::Load(std::string path)
+{
+    PROFILE_ZONE("TrackLoader::Load");
+    ALLOCATION_TAG(AllocationTag::FILE);
+
+    MappedFile file;
+    TrackView view;
+
+    bool baked = false;
+    bool ok = file.Open(path);
+
+    if (ok && view.Open(file.Data(), file.Size()))
+    {
+        size_t count = static_cast<size_t>(view.NodeCount());
+
+        // used in place from the mapping, pages are read as they are used
+        const vec3* points = view.Get<vec3>(CHUNK_POINTS, count);
+        const vec3* controls = view.Get<vec3>(CHUNK_CONTROLS, count);
+        const vec3* normals = view.Get<vec3>(CHUNK_NORMALS, count);
+        const float* lengths = view.Get<float>(CHUNK_LENGTHS, count);
+        const float* arc_lengths = view.Get<float>(CHUNK_ARC_LENGTHS, count, Spline::arc_samples);
+
+        ok = points != nullptr && controls != nullptr && normals != nullptr;
+        baked = ok && lengths != nullptr && arc_lengths != nullptr;
+
+        if (ok)
+        {
+            // the preview is shown straight away, while crcs are checked
+            // alongside building the nodes. the load fails afterwards if
+            // the nodes do not match them.
+            SetPreview(points, count);
+
+            const uint32_t ids[5] =
+            {
+                CHUNK_POINTS,
+                CHUNK_CONTROLS,
+                CHUNK_NORMALS,
+                CHUNK_LENGTHS,
+                CHUNK_ARC_LENGTHS
+            };
+
+            bool verified[5] = {};
+            TaskGraph graph;
+
+            for (size_t k = 0; k < (baked ? 5 : 3); k++)
+            {
+                graph.Add([&, k]()
+                {
+                    verified[k] = view.Verify(ids[k]);
+                });
+            }
+
+            graph.Add([&]()
+            {
+                loaded.Assign(points, controls, normals, count);
+
+                if (baked)
+                {
+                    loaded.Restore(lengths, arc_lengths);
+                }
+                else
+                {
+                    loaded.Prepare();
+                }
+            });
+
+            graph.Run(JobSystem::Default());
+
+            ok = verified[0] && verified[1] && verified[2];
+
+            // bad caches are integrated again over what Restore prepared
+            baked = baked && verified[3] && verified[4];
+        }
+    }
+    else if (ok)
+    {
+        file.Close();
+
+        std::ifstream stream(
+            path,
+            std::ios::binary);
+
+        std::vector<vec3> points, controls, normals;
+        ok = stream.is_open() && read_track_v1(stream, points, controls, normals);
+
+        if (ok)
+        {
+            SetPreview(points.data(), points.size());
+            loaded.Assign(points.data(), controls.data(), normals.data(), points.size());
+            loaded.Prepare();
+        }
+    }
+
+    file.Close();
+
+    if (!ok)
+    {
+        state = static_cast<int>(LoadState::FAILED);
+        return;
+    }
+
+    size_t count = loaded.count;
+    segments_total = count;
+
+    if (baked)
+    {
+        segments_done = count;
+        state = static_cast<int>(LoadState::DONE);
+        return;
+    }
+
+    // node chunks are independent, progress is counted per chunk
+    JobSystem::Default().ParallelFor(
+        loaded.nodes.Chunks().size(),
+        1,
+        [this](size_t first, size_t last)
+    {
+        for (size_t c = first; c < last; c++)
+        {
+            loaded.IntegrateChunk(c);
+            segments_done += loaded.nodes.Chunks()[c]->Size();
+        }
+    });
+
+    loaded.Finish();
+
+    state = static_cast<int>(LoadState::DONE);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Math.hpp"
+#include "Spline.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class LoadState
+{
+    IDLE,
+    LOADING,
+    DONE,
+    FAILED
+};
+
+// loads a track on a worker thread, publishing a decimated preview of the
+// points as soon as they are read and then integrating the segment lengths
+// in chunks on the job system
+class TrackLoader
+{
+public:
+    // most points kept in the preview
+    size_t preview_size = 4096;
+
+    TrackLoader() = default;
+    TrackLoader(const TrackLoader&) = delete;
+    TrackLoader& operator=(const TrackLoader&) = delete;
+    ~TrackLoader();
+
+    void Start(const std::string& path);
+    LoadState State() const;
+
+    // fraction of the segment lengths computed
+    float Progress() const;
+
+    // copies the preview, false until the points have been read
+    bool GetPreview(std::vector<vec3>& points);
+
+    // moves the loaded spline into target, keeping its listeners
+    bool Take(Spline& target);
+
+private:
+    std::thread worker;
+    std::mutex mutex;
+
+    std::atomic<int> state { static_cast<int>(LoadState::IDLE) };
+    std::atomic<size_t> segments_done { 0 };
+    std::atomic<size_t> segments_total { 0 };
+
+    Spline loaded;
+    std::vector<vec3> preview;
+    bool preview_ready = false;
+
+    void Load(std::string path);
+    void SetPreview(const vec3* points, size_t count);
+};
@@ -4,7 +4,16 @@
 #include "Drawing.hpp"
 #include "Spline.hpp"
 #include "System.hpp"
+#include "Tessellation.hpp"
+#include "Picking.hpp"
 #include "File.hpp"
+#include "Autosave.hpp"
+#include "History.hpp"
+#include "Loader.hpp"
+#include "FileDialog.hpp"
+#include "Profiler.hpp"
+#include "Allocation.hpp"
+#include "FrameArena.hpp"
 
 using namespace SDLSystem;
 
@@ -15,15 +24,8 @@ enum class ApplicationState
     PLACEMENT,
     MOVEMENT,
     SAVE,
-    LOAD
-};
-
-enum class PickingType
-{
-    NONE,
-    POINT,
-    CONTROL,
-    NORMAL,
+    LOAD,
+    LOADING
 };
 
 ApplicationState app_state = ApplicationState::DEFAULT;
@@ -41,80 +43,289 @@ vec3 view_side_vector = vec3(1, 0, 0);
 float point_size = 20.0f;
 size_t point_picked_id = 0;
 PickingType point_picked_type = PickingType::NONE;
+HandlePicker handle_picker;
+PickResult handle_hover;
+TrackAutosave autosave;
+EditHistory history;
+TrackLoader track_loader;
+std::vector<vec3> load_preview;
 std::string track_path;
 Spline path;
+TrackTessellation track_mesh;
+VertexPipeline track_pipeline;
+
+std::vector<size_t> visible_segments;
+std::vector<size_t> track_visible;
+
+bool frame_graph = false;
+bool frame_graph_key = false;
+bool trace_key = false;
+bool delete_key = false;
+bool split_key = false;
+bool undo_key = false;
+bool redo_key = false;
+bool oldest_key = false;
+bool newest_key = false;
+double trace_seconds = 10.0;
+std::string trace_path = "superrocket-trace.json";
+
+// with --no-alloc, a frame that changed nothing after one that changed
+// nothing either must not allocate on the main thread
+bool no_alloc_check = false;
+bool steady_frame = false;
+bool previous_steady_frame = false;
 
 void write_track()
 {
     if (track_path == "")
     {
-        track_path = win_file_dialog(
+        track_path = file_dialog(
             FileDialogType::SAVE);
     }
 
-    std::ofstream myfile(
-        track_path,
-        std::ios::binary);
-
-    if (!myfile.is_open())
+    if (track_path == "")
     {
-        // TODO alert error
         return;
     }
 
-    serialize(myfile, path.points);
-    serialize(myfile, path.controls);
-    serialize(myfile, path.normals);
-    serialize(myfile, path.lengths);
-    myfile.close();
-
-    cout << "Saved: " << track_path << std::endl;
+    // written in the background, the worker reports when done
+    autosave.Save(track_path, path);
 }
 
 void read_track()
 {
-    track_path = win_file_dialog(
+    track_path = file_dialog(
         FileDialogType::OPEN);
 
-    std::ifstream myfile(
-        track_path,
-        std::ios::binary);
+    if (track_path == "")
+    {
+        return;
+    }
+
+    // finished by finish_read_track once the loader is done
+    load_preview.clear();
+    track_loader.Start(track_path);
+}
+
+void finish_read_track()
+{
+    cout << "Loaded: " << track_path << std::endl;
+
+    size_t recovered = autosave.Open(track_path, path);
+
+    // recovered edits are part of the loaded track, not undoable
+    history.Clear();
+
+    if (recovered > 0)
+    {
+        cout << "Recovered " << recovered << " edits" << std::endl;
+    }
+}
+
+void build_track_pipeline()
+{
+    PROFILE_ZONE("build track pipeline");
+
+    track_pipeline.Clear();
 
-    if (!myfile.is_open())
+    // left, right and both ground vertices per sample
+    for (size_t i : track_visible)
+    {
+        auto& mesh = track_mesh.Mesh(path, i);
+
+        for (size_t k = 0; k < mesh.left.size(); k++)
+        {
+            track_pipeline.AddVertex(mesh.left[k]);
+            track_pipeline.AddVertex(mesh.right[k]);
+            track_pipeline.AddVertex(mesh.left_ground[k]);
+            track_pipeline.AddVertex(mesh.right_ground[k]);
+        }
+    }
+
+    uint32_t base = 0;
+
+    for (size_t j = 0; j < track_visible.size(); j++)
+    {
+        size_t i = track_visible[j];
+        uint32_t n = static_cast<uint32_t>(track_mesh.Mesh(path, i).left.size());
+
+        // the last sample is drawn by the next segment when it is visible
+        size_t next = (j + 1) % track_visible.size();
+        bool shared = track_visible[next] == (i + 1) % path.count;
+
+        for (uint32_t k = 0; k < (shared ? n - 1 : n); k++)
+        {
+            uint32_t v = base + k * 4;
+
+            track_pipeline.AddLine(v + 0, v + 1);
+            track_pipeline.AddLine(v + 0, v + 2);
+            track_pipeline.AddLine(v + 1, v + 3);
+        }
+
+        base += n * 4;
+    }
+
+    // rails last and in order, so each is submitted as few strips
+    for (uint32_t side = 0; side < 2; side++)
+    {
+        base = 0;
+
+        for (size_t i : track_visible)
+        {
+            uint32_t n = static_cast<uint32_t>(track_mesh.Mesh(path, i).left.size());
+
+            for (uint32_t k = 0; k + 1 < n; k++)
+            {
+                uint32_t v = base + k * 4 + side;
+                track_pipeline.AddLine(v, v + 4);
+            }
+
+            base += n * 4;
+        }
+    }
+}
+
+// true once when a key is let go
+bool key_released(uint16_t key, bool& held)
+{
+    bool down = sys->IsKeyDown(key);
+    bool released = held && !down;
+    held = down;
+
+    return released;
+}
+
+void write_trace()
+{
+    if (profile_write_trace(trace_path, trace_seconds))
+    {
+        cout << "Trace: " << trace_path << std::endl;
+    }
+    else
+    {
+        cout << "Trace failed: " << trace_path << std::endl;
+    }
+}
+
+// one column per frame, oldest on the left, with a line at 60hz
+void draw_frame_graph()
+{
+    float times[profile_frame_count];
+    size_t count = profile_frame_times(times, profile_frame_count);
+
+    float pixels_per_ms = 2.0f;
+    float x0 = 20.0f;
+    float y0 = window_height - 20.0f;
+
+    set_draw_color(0, 255, 0, SDL_ALPHA_OPAQUE);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        float x = x0 + i;
+        draw_commands.Line(x, y0, x, y0 - times[i] * pixels_per_ms);
+    }
+
+    float y = y0 - 16.7f * pixels_per_ms;
+
+    set_draw_color(255, 0, 0, SDL_ALPHA_OPAQUE);
+    draw_commands.Line(x0, y, x0 + profile_frame_count, y);
+
+    // frame arena use below, against its high water mark and capacity
+    FrameArena& arena = FrameArena::Frame();
+    float scale = static_cast<float>(profile_frame_count) / arena.Capacity();
+    float used = x0 + arena.LastFrameUsed() * scale;
+    float high = x0 + arena.HighWater() * scale;
+
+    set_draw_color(128, 128, 128, SDL_ALPHA_OPAQUE);
+    draw_commands.Line(x0, y0 + 6, x0 + profile_frame_count, y0 + 6);
+
+    set_draw_color(0, 255, 255, SDL_ALPHA_OPAQUE);
+    draw_commands.Line(x0, y0 + 6, used, y0 + 6);
+    draw_commands.Line(high, y0 + 3, high, y0 + 9);
+
+    if (!allocation_tracking())
     {
-        // TODO alert error
         return;
     }
 
-    path.points.clear();
-    path.controls.clear();
-    path.normals.clear();
-    path.lengths.clear();
+    // allocations per frame above, a pixel each
+    uint32_t allocations[allocation_frame_history];
+    count = allocation_frame_counts(allocations, allocation_frame_history);
+    y = y0 - 80.0f;
+
+    set_draw_color(255, 255, 0, SDL_ALPHA_OPAQUE);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (allocations[i] > 0)
+        {
+            float x = x0 + i;
+            draw_commands.Line(x, y, x, y - glm::min(allocations[i], 40u));
+        }
+    }
+}
+
+// the last frame has been closed by the time the next one starts
+void check_frame_allocations()
+{
+    if (!no_alloc_check ||
+        !steady_frame ||
+        !previous_steady_frame ||
+        allocation_last_frame_count() == 0)
+    {
+        return;
+    }
 
-    deserialize(myfile, path.points);
-    deserialize(myfile, path.controls);
-    deserialize(myfile, path.normals);
-    deserialize(myfile, path.lengths);
+    cout << "Steady frame allocated:" << std::endl;
 
-    path.Update();
+    for (size_t i = 0; i < static_cast<size_t>(AllocationTag::COUNT); i++)
+    {
+        AllocationTag tag = static_cast<AllocationTag>(i);
+        AllocationCounters counters = allocation_last_frame(tag);
 
-    myfile.close();
+        if (counters.count > 0)
+        {
+            cout << "  " << allocation_tag_name(tag) << ": " <<
+                counters.count << " allocations, " <<
+                counters.bytes << " bytes" << std::endl;
+        }
+    }
 
-    cout << "Loaded: " << track_path << std::endl;
+    exit(1);
 }
 
 void init()
 {
     renderer = sys->renderer;
+
+    // every edit goes to the journal of the current track, and shows
+    path.AddListener([](const SplineEdit& edit)
+    {
+        autosave.Record(edit);
+        sys->RequestRedraw();
+    });
+
+    history.Attach(path);
 }
 
 void update()
 {
+    PROFILE_ZONE("update");
+
+    check_frame_allocations();
+
+    uint64_t revision = path.revision;
+    bool rebuilt = false;
+    bool traced = false;
+
     SDL_GetWindowSize(sys->window, &window_width, &window_height);
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
 
-    if (app_state == ApplicationState::VIEW)
+    ApplicationState previous_state = app_state;
+    bool loading = app_state == ApplicationState::LOADING;
+
+    if (app_state == ApplicationState::VIEW || (loading && sys->mouse_active))
     {
         view_yaw += static_cast<float>(sys->mouse_delta_x * 10) / window_width;
         view_pitch += static_cast<float>(sys->mouse_delta_y * 10) / window_height;
@@ -162,6 +373,42 @@ void update()
 
     projection_view = projection * view;
 
+    handle_hover = PickResult();
+
+    if (key_released(103, frame_graph_key)) // G
+    {
+        frame_graph = !frame_graph;
+    }
+    if (key_released(116, trace_key)) // T
+    {
+        write_trace();
+        traced = true;
+    }
+
+    // ctrl z and ctrl y step through the history, ctrl home and ctrl end
+    // jump to either end of it
+    bool control = sys->IsKeyDown(224) || sys->IsKeyDown(228);
+    bool editable = app_state == ApplicationState::DEFAULT;
+
+    if (key_released(122, undo_key) && control && editable)
+    {
+        history.Undo();
+    }
+    if (key_released(121, redo_key) && control && editable)
+    {
+        history.Redo();
+    }
+    if (key_released(74, oldest_key) && control && editable)
+    {
+        history.Jump(history.First());
+    }
+    if (key_released(77, newest_key) && control && editable)
+    {
+        history.Jump(history.Last());
+    }
+
+    PROFILE_BEGIN(state_zone, "update state");
+
     switch (app_state)
     {
         case ApplicationState::DEFAULT:
@@ -188,88 +435,49 @@ void update()
                 break;
             }
 
-            // control point picking
+            // control point picking, also run every frame for hovering
             {
-                if (sys->mouse_click_down)
-                {
-                    // render control points for picking
-                    bool point_pick_active = false;
+                handle_picker.pixel_size = view_pixel_size();
+                handle_picker.point_size = point_size;
 
-                    // points
-                    uint32_t color_counter = 1;
-                    for (auto point : path.points)
-                    {
-                        SDL_SetRenderDrawColor(renderer,
-                            1,
-                            (color_counter >> 8)  & 0x0000ff00,
-                            (color_counter >> 0)  & 0x000000ff,
-                            255);
-                        draw_point_3d(point, point_size);
-                        color_counter++;
-                    }
+                vec3 ray_origin, ray_direction;
+                picking_ray(
+                    ray_origin,
+                    ray_direction,
+                    sys->mouse_x,
+                    sys->mouse_y);
 
-                    // control points
-                    color_counter = 1;
-                    for (auto i = 0; i < path.points.size(); i++)
-                    {
-                        SDL_SetRenderDrawColor(renderer,
-                            2,
-                            (color_counter >> 8) & 0x0000ff00,
-                            (color_counter >> 0) & 0x000000ff,
-                            255);
-
-                        vec3 control = path.points[i] + path.controls[i];
-                        draw_point_3d(control, point_size);
-                        color_counter++;
-                    }
+                handle_hover = handle_picker.Pick(
+                    path,
+                    ray_origin,
+                    ray_direction,
+                    -view_vector);
 
-                    // normal
-                    color_counter = 1;
-                    for (auto i = 0; i < path.points.size(); i++)
-                    {
-                        SDL_SetRenderDrawColor(renderer,
-                            3,
-                            (color_counter >> 8) & 0x0000ff00,
-                            (color_counter >> 0) & 0x000000ff,
-                            255);
-
-                        vec3 control = path.points[i] + path.normals[i] * 0.5f;
-
-                        draw_point_3d(
-                            control,
-                            point_size);
-                        color_counter++;
-                    }
+                if (sys->mouse_click_down &&
+                    handle_hover.type != PickingType::NONE)
+                {
+                    point_picked_id = handle_hover.id;
+                    point_picked_type = handle_hover.type;
+                    app_state = ApplicationState::MOVEMENT;
 
-                    // get color of picked point
-                    SDL_Color rgb;
-                    const Uint32 format = SDL_PIXELFORMAT_ARGB8888;
-                    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(
-                        0, window_width, window_height, 32, format);
-                    SDL_LockSurface(surface);
-                    SDL_RenderReadPixels(
-                        sys->renderer, NULL, format, surface->pixels, surface->pitch);
-                    auto data = GetPixel(surface, sys->mouse_x, sys->mouse_y);
-                    SDL_GetRGB(data, surface->format, &rgb.r, &rgb.g, &rgb.b);
-
-                    uint32_t id = (rgb.g << 8) + rgb.b;
-                    uint32_t type = rgb.r;
-
-                    if (id > 0)
-                    {
-                        id = id - 1;
-                        point_pick_active = true;
-                        point_picked_id = id;
-                        point_picked_type = static_cast<PickingType>(type);
-                    }
-                    SDL_UnlockSurface(surface);
-                    SDL_FreeSurface(surface);
+                    // the whole drag is undone at once
+                    history.Begin();
+                    break;
+                }
 
-                    if (point_pick_active)
-                    {
-                        app_state = ApplicationState::MOVEMENT;
-                        break;
-                    }
+                bool point_hovered = handle_hover.type == PickingType::POINT;
+
+                if (key_released(120, delete_key) && point_hovered) // X
+                {
+                    path.DeletePoint(handle_hover.id);
+                    handle_hover = PickResult();
+                }
+                // adds a point on the curve halfway along the segment
+                // after the hovered point
+                if (key_released(110, split_key) && point_hovered && // N
+                    handle_hover.id + 1 < path.count)
+                {
+                    path.InsertPointOnCurve(handle_hover.id, 0.5f);
                 }
             }
             break;
@@ -287,9 +495,38 @@ void update()
             if (!sys->IsKeyDown(58))
             {
                 read_track();
+                app_state = track_loader.State() == LoadState::LOADING ?
+                    ApplicationState::LOADING :
+                    ApplicationState::DEFAULT;
+                break;
+            }
+            break;
+
+        case ApplicationState::LOADING:
+            // the camera can be moved while the track loads
+            if (sys->IsKeyDown(32))
+            {
+                sys->SetMouseActive(true);
+            }
+
+            if (track_loader.State() == LoadState::FAILED)
+            {
+                cout << "Load failed: " << track_path << std::endl;
+                app_state = ApplicationState::DEFAULT;
+                break;
+            }
+
+            if (track_loader.Take(path))
+            {
+                finish_read_track();
                 app_state = ApplicationState::DEFAULT;
                 break;
             }
+
+            if (load_preview.empty())
+            {
+                track_loader.GetPreview(load_preview);
+            }
             break;
 
         case ApplicationState::VIEW:
@@ -303,18 +540,20 @@ void update()
         case ApplicationState::MOVEMENT:
             if (!sys->mouse_down)
             {
+                history.End();
                 app_state = ApplicationState::DEFAULT;
                 break;
             }
 
+            handle_hover.type = point_picked_type;
+            handle_hover.id = point_picked_id;
+
             // move control point
             {
-                vec3 point_position =
-                    path.points[point_picked_id];
+                SplineNode picked = path.Node(point_picked_id);
 
-                vec3 control_position =
-                    path.controls[point_picked_id] +
-                    point_position;
+                vec3 point_position = picked.point;
+                vec3 control_position = picked.control + point_position;
 
                 vec3 plane_position = point_position;
                 vec3 plane_normal = view_up_vector;
@@ -330,7 +569,7 @@ void update()
                 else if (point_picked_type == PickingType::NORMAL)
                 {
                     plane_position = point_position;
-                    plane_normal = glm::normalize(path.controls[point_picked_id]);
+                    plane_normal = glm::normalize(picked.control);
 
                     if (glm::dot(view_position - plane_position, plane_normal) < 0)
                     {
@@ -424,13 +663,17 @@ void update()
             break;
     }
 
+    PROFILE_END(state_zone);
+
     // rendering
     {
+        PROFILE_ZONE("render");
+
         float grid_scale = 1;
 
         // render grid
 
-        SDL_SetRenderDrawColor(renderer, 128, 128, 128, SDL_ALPHA_OPAQUE);
+        set_draw_color(128, 128, 128, SDL_ALPHA_OPAQUE);
 
         for (int16_t i = -20; i < 21; i++)
         {
@@ -443,128 +686,228 @@ void update()
             draw_line_3d(z0, z1);
         }
 
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
+        set_draw_color(255, 255, 255, SDL_ALPHA_OPAQUE);
 
         // render track
-        if (path.points.size() > 2)
+        if (!loading && path.count > 2)
         {
-            float path_width = 0.2f;
+            // only segments inside the view are tessellated and drawn
+            Frustum frustum = Frustum::FromMatrix(projection_view);
+
+            // both lists swap places, and never grow once this large
+            visible_segments.clear();
+            visible_segments.reserve(path.count);
+            path.Cull(
+                frustum,
+                track_mesh.width,
+                true,
+                visible_segments);
+
+            // detail follows screen size, edits being dragged are kept
+            // coarse until the handle is released
+            track_mesh.pixel_size = view_pixel_size();
+            track_mesh.view_position = view_position;
+            track_mesh.preview = app_state == ApplicationState::MOVEMENT;
+
+            track_mesh.Update(path, visible_segments);
+
+            if (track_mesh.rebuilt > 0 || visible_segments != track_visible)
+            {
+                track_visible.swap(visible_segments);
+                build_track_pipeline();
+                rebuilt = true;
+            }
 
-            float offset = 0;
-            float offset_prev = 0;
+            draw_pipeline(track_pipeline);
+        }
 
-            vec3 track_left_start;
-            vec3 track_right_start;
+        // render track control points
+        if (!loading)
+        {
+            const auto& chunks = path.nodes.Chunks();
 
-            vec3 track_left;
-            vec3 track_right;
+            set_draw_color(0, 255, 0, 255);
 
-            vec3 track_left_prev;
-            vec3 track_right_prev;
+            for (const auto& chunk : chunks)
+            {
+                for (const SplineNode& node : chunk->nodes)
+                {
+                    draw_point_3d(node.point, point_size);
+                }
+            }
 
-            bool is_start_point_set = false;
+            set_draw_color(0, 0, 255, 255);
 
-            for (float t = 0; t < path.total_length; t += 0.5f)
+            for (const auto& chunk : chunks)
             {
-                offset_prev = offset;
-                track_left_prev = track_left;
-                track_right_prev = track_right;
+                for (const SplineNode& node : chunk->nodes)
+                {
+                    vec3 point = node.point;
+                    vec3 direction = node.control;
+                    vec3 control = point + direction;
 
-                offset = path.GetNormalisedOffset(t);
+                    draw_point_3d(
+                        control,
+                        point_size);
 
-                vec3 position = path.GetPoint(offset);
-                vec3 gradient = glm::normalize(path.GetGradient(offset));
-                vec3 side = glm::cross(gradient, path.GetNormal(offset)) * path_width;
+                    draw_line_3d(
+                        point + direction,
+                        point - direction);
+                }
+            }
+
+            set_draw_color(255, 0, 0, 255);
 
-                track_left = position + side;
-                track_right = position - side;
+            for (const auto& chunk : chunks)
+            {
+                for (const SplineNode& node : chunk->nodes)
+                {
+                    vec3 point = node.point;
+                    vec3 direction = node.normal;
+                    vec3 control = point + direction * 0.5f;
 
-                vec3 track_left_ground = vec3(track_left.x, 0, track_left.z);
-                vec3 track_right_ground = vec3(track_right.x, 0, track_right.z);
-                vec3 track_left_ground_prev = vec3(track_left_prev.x, 0, track_left_prev.z);
-                vec3 track_right_ground_prev = vec3(track_right_prev.x, 0, track_right_prev.z);
+                    draw_point_3d(
+                        control,
+                        point_size);
 
-                SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
+                    draw_line_3d(
+                        point,
+                        control);
+                }
+            }
 
-                draw_line_3d(track_left, track_right);
-                draw_line_3d(track_left, track_left_ground);
-                draw_line_3d(track_right, track_right_ground);
+            // highlight the handle under the mouse
+            if (handle_hover.type != PickingType::NONE && handle_hover.id < path.count)
+            {
+                const SplineNode& node = path.Node(handle_hover.id);
+                vec3 handle = node.point;
 
-                if (is_start_point_set)
+                if (handle_hover.type == PickingType::CONTROL)
                 {
-                    draw_line_3d(track_left_prev, track_left);
-                    draw_line_3d(track_right_prev, track_right);
+                    handle += node.control;
                 }
-                else
+                else if (handle_hover.type == PickingType::NORMAL)
                 {
-                    track_left_start = track_left;
-                    track_right_start = track_right;
-                    is_start_point_set = true;
+                    handle += node.normal * 0.5f;
                 }
-            }
 
-            draw_line_3d(track_left, track_left_start);
-            draw_line_3d(track_right, track_right_start);
+                set_draw_color(255, 255, 0, 255);
+                draw_point_3d(handle, point_size);
+            }
         }
+    }
 
-        // render track control points
-        {
-            SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255);
+    // preview and progress of a track being loaded
+    if (loading)
+    {
+        set_draw_color(255, 255, 255, SDL_ALPHA_OPAQUE);
 
-            for (auto point : path.points)
-            {
-                draw_point_3d(point, point_size);
-            }
+        for (size_t i = 0; i + 1 < load_preview.size(); i++)
+        {
+            draw_line_3d(load_preview[i], load_preview[i + 1]);
+        }
 
-            SDL_SetRenderDrawColor(renderer, 0, 0, 255, 255);
+        if (load_preview.size() > 2)
+        {
+            draw_line_3d(load_preview.back(), load_preview.front());
+        }
 
-            for (auto i = 0; i < path.points.size(); i++)
-            {
-                vec3 point = path.points[i];
-                vec3 direction = path.controls[i];
-                vec3 control = point + direction;
+        float x0 = 20.0f;
+        float x1 = window_width - 20.0f;
+        float y0 = window_height - 30.0f;
+        float y1 = window_height - 20.0f;
+        float x = x0 + (x1 - x0) * track_loader.Progress();
 
-                draw_point_3d(
-                    control,
-                    point_size);
+        draw_commands.Line(x0, y0, x1, y0);
+        draw_commands.Line(x1, y0, x1, y1);
+        draw_commands.Line(x1, y1, x0, y1);
+        draw_commands.Line(x0, y1, x0, y0);
 
-                draw_line_3d(
-                    point + direction,
-                    point - direction);
-            }
+        for (float y = y0; y <= y1; y++)
+        {
+            draw_commands.Line(x0, y, x, y);
+        }
+    }
 
-            SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
+    if (frame_graph)
+    {
+        draw_frame_graph();
+    }
 
-            for (auto i = 0; i < path.points.size(); i++)
-            {
-                vec3 point = path.points[i];
-                vec3 direction = path.normals[i];
-                vec3 control = point + direction * 0.5f;
+    flush_draw_commands();
 
-                draw_point_3d(
-                    control,
-                    point_size);
+    // frames are otherwise only drawn on input, so keep them coming while
+    // the view moves on held keys, a load progresses or the state changed
+    bool moving =
+        sys->IsKeyDown(119) ||
+        sys->IsKeyDown(115) ||
+        sys->IsKeyDown(97) ||
+        sys->IsKeyDown(100);
 
-                draw_line_3d(
-                    point,
-                    control);
-            }
-        }
+    if (moving || loading || frame_graph || app_state != previous_state)
+    {
+        sys->RequestRedraw();
     }
 
+    // only the camera moved, if anything, and nothing was rebuilt for it
+    previous_steady_frame = steady_frame;
+    steady_frame =
+        !loading &&
+        !rebuilt &&
+        !traced &&
+        app_state == previous_state &&
+        (app_state == ApplicationState::DEFAULT || app_state == ApplicationState::VIEW) &&
+        path.revision == revision;
+
     sys->FrameUpdate();
 }
 
 int main(int argc, char *argv[])
 {
+    bool vsync = false;
+    uint32_t max_frame_rate = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "--vsync")
+        {
+            vsync = true;
+        }
+        else if (arg == "--fps" && i + 1 < argc)
+        {
+            max_frame_rate = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--no-alloc")
+        {
+            no_alloc_check = true;
+        }
+        else if (arg == "--history-mb" && i + 1 < argc)
+        {
+            history.memory_cap = static_cast<size_t>(strtoul(argv[++i], nullptr, 10)) << 20;
+        }
+    }
+
     sys = make_shared<System>([=]()
     {
         update();
-    });
+    }, vsync);
+
+    sys->max_frame_rate = max_frame_rate;
+
+    if (no_alloc_check && !allocation_tracking())
+    {
+        cout << "--no-alloc needs SUPERROCKET_ALLOCATION_TRACKING" << std::endl;
+        return 1;
+    }
 
     init();
 
     sys->Run();
 
+    cout << "Frame arena high water: " <<
+        FrameArena::Frame().HighWater() << " bytes" << std::endl;
+
     return 0;
 }
@@ -0,0 +1,106 @@
+#include "Picking.hpp"
+
+#include "Allocation.hpp"
+#include "Profiler.hpp"
+
+#include <cfloat>
+
+static bool ray_box(
+    vec3 origin,
+    vec3 inverse_direction,
+    const Aabb& box)
+{
+    vec3 t0 = (box.min - origin) * inverse_direction;
+    vec3 t1 = (box.max - origin) * inverse_direction;
+
+    vec3 lo = glm::min(t0, t1);
+    vec3 hi = glm::max(t0, t1);
+
+    float enter = glm::max(glm::max(lo.x, lo.y), lo.z);
+    float exit = glm::min(glm::min(hi.x, hi.y), hi.z);
+
+    return enter <= exit && exit >= 0.0f;
+}
+
+float HandlePicker::Radius(float depth) const
+{
+    return glm::max(point_size, min_point_size * depth) * pixel_size;
+}
+
+PickResult HandlePicker::Pick(
+    const Spline& spline,
+    vec3 origin,
+    vec3 direction,
+    vec3 forward)
+{
+    PROFILE_ZONE("HandlePicker::Pick");
+    ALLOCATION_TAG(AllocationTag::PICKING);
+
+    PickResult result;
+
+    direction = glm::normalize(direction);
+    vec3 inverse_direction = 1.0f / direction;
+
+    ArenaVector<size_t> candidates;
+    spline.nodes.QueryNodes([&](const Aabb& box)
+    {
+        // grow by the largest handle radius at the far side of the box
+        vec3 center = (box.min + box.max) * 0.5f;
+        vec3 extent = (box.max - box.min) * 0.5f;
+        float depth =
+            glm::dot(center - origin, forward) +
+            glm::dot(extent, glm::abs(forward));
+
+        if (depth <= 0.0f)
+        {
+            return false;
+        }
+
+        float radius = Radius(depth);
+
+        Aabb grown = box;
+        grown.min -= vec3(radius);
+        grown.max += vec3(radius);
+
+        return ray_box(origin, inverse_direction, grown);
+    }, candidates);
+
+    float best = FLT_MAX;
+
+    for (size_t i : candidates)
+    {
+        const SplineNode& node = spline.Node(i);
+
+        const vec3 handles[3] =
+        {
+            node.point,
+            node.point + node.control,
+            node.point + node.normal * 0.5f
+        };
+
+        for (int h = 0; h < 3; h++)
+        {
+            vec3 d = handles[h] - origin;
+            float depth = glm::dot(d, forward);
+
+            if (depth <= 0.0f)
+            {
+                continue;
+            }
+
+            float t = glm::dot(d, direction);
+            float radius = Radius(depth);
+            float distance_sq = glm::dot(d, d) - t * t;
+
+            if (distance_sq <= radius * radius && t < best)
+            {
+                best = t;
+                result.type = static_cast<PickingType>(h + 1);
+                result.id = i;
+                result.distance = t;
+            }
+        }
+    }
+
+    return result;
+}
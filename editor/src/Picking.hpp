@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Math.hpp"
+#include "Culling.hpp"
+#include "FrameArena.hpp"
+#include "Spline.hpp"
+
+#include <vector>
+
+enum class PickingType
+{
+    NONE,
+    POINT,
+    CONTROL,
+    NORMAL,
+};
+
+struct PickResult
+{
+    PickingType type = PickingType::NONE;
+    size_t id = 0;
+
+    // distance along the ray to the closest approach
+    float distance = 0.0f;
+};
+
+// picks the point, control and normal handles of a spline by casting a ray
+// against spheres that match the size the handles are drawn at on screen
+class HandlePicker
+{
+public:
+    // world size of one pixel at a view depth of one
+    float pixel_size = 0.0f;
+
+    // handle radius in pixels at a view depth of one, and the minimum
+    // radius in pixels at any depth
+    float point_size = 20.0f;
+    float min_point_size = 3.0f;
+
+    // searches the boxes the spline keeps around each node's handles,
+    // which every edit keeps current
+    PickResult Pick(
+        const Spline& spline,
+        vec3 origin,
+        vec3 direction,
+        vec3 forward);
+
+private:
+    float Radius(float depth) const;
+};
@@ -0,0 +1,236 @@
+#include "Profiler.hpp"
+
+#include "Allocation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+// zones of one thread. only the owning thread writes, readers check the
+// head again after copying and drop anything overwritten meanwhile.
+struct ProfileRing
+{
+    ProfileEvent events[profile_ring_size];
+    std::atomic<uint64_t> head { 0 };
+    std::atomic<bool> in_use { true };
+    size_t thread_id = 0;
+};
+
+// rings outlive their threads, a thread that exits leaves its zones for
+// the next thread to start to take over. they are never freed, as threads
+// owned by other static objects may still exit after this file's statics
+// are destroyed.
+static std::mutex& rings_mutex()
+{
+    static std::mutex* mutex = new std::mutex();
+    return *mutex;
+}
+
+static std::vector<ProfileRing*>& all_rings()
+{
+    static std::vector<ProfileRing*>* rings = new std::vector<ProfileRing*>();
+    return *rings;
+}
+
+struct ProfileRingOwner
+{
+    ProfileRing* ring = nullptr;
+
+    ~ProfileRingOwner()
+    {
+        if (ring != nullptr)
+        {
+            ring->in_use = false;
+        }
+    }
+};
+
+static thread_local ProfileRingOwner ring_owner;
+
+static ProfileRing* thread_ring()
+{
+    if (ring_owner.ring != nullptr)
+    {
+        return ring_owner.ring;
+    }
+
+    ALLOCATION_TAG(AllocationTag::PROFILER);
+
+    std::lock_guard<std::mutex> lock(rings_mutex());
+    std::vector<ProfileRing*>& rings = all_rings();
+
+    for (ProfileRing* ring : rings)
+    {
+        bool idle = false;
+
+        if (ring->in_use.compare_exchange_strong(idle, true))
+        {
+            ring_owner.ring = ring;
+            return ring;
+        }
+    }
+
+    ProfileRing* ring = new ProfileRing();
+    ring->thread_id = rings.size() + 1;
+    rings.push_back(ring);
+    ring_owner.ring = ring;
+
+    return ring;
+}
+
+static float frame_times[profile_frame_count];
+static size_t frame_total = 0;
+
+uint64_t profile_now()
+{
+    static const auto epoch = std::chrono::steady_clock::now();
+
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - epoch).count());
+}
+
+ProfileZone::ProfileZone(const char* name) :
+    name(name),
+    start(profile_now())
+{
+}
+
+ProfileZone::~ProfileZone()
+{
+    End();
+}
+
+void ProfileZone::End()
+{
+    if (!ended)
+    {
+        profile_record(name, start, profile_now());
+        ended = true;
+    }
+}
+
+void profile_record(const char* name, uint64_t start, uint64_t end)
+{
+    ProfileRing* ring = thread_ring();
+
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    ProfileEvent& event = ring->events[head % profile_ring_size];
+
+    event.name.store(name, std::memory_order_relaxed);
+    event.start.store(start, std::memory_order_relaxed);
+    event.end.store(end, std::memory_order_relaxed);
+
+    ring->head.store(head + 1, std::memory_order_release);
+
+    // the next zone's writes must not be seen before this head
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void profile_frame(uint64_t start, uint64_t end)
+{
+    frame_times[frame_total % profile_frame_count] = (end - start) * 1e-6f;
+    frame_total++;
+}
+
+size_t profile_frame_times(float* times, size_t max)
+{
+    size_t n = std::min(std::min(frame_total, profile_frame_count), max);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        times[i] = frame_times[(frame_total - n + i) % profile_frame_count];
+    }
+
+    return n;
+}
+
+bool profile_write_trace(const std::string& path, double seconds)
+{
+    ALLOCATION_TAG(AllocationTag::PROFILER);
+
+    struct Zone
+    {
+        const char* name;
+        uint64_t start;
+        uint64_t end;
+        size_t thread_id;
+    };
+
+    std::vector<Zone> zones;
+
+    uint64_t now = profile_now();
+    double window = seconds * 1e9;
+    uint64_t since = now > window ? now - static_cast<uint64_t>(window) : 0;
+
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex());
+
+        for (ProfileRing* ring : all_rings())
+        {
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t first = head > profile_ring_size ? head - profile_ring_size : 0;
+            size_t copied = zones.size();
+
+            for (uint64_t i = first; i < head; i++)
+            {
+                const ProfileEvent& event = ring->events[i % profile_ring_size];
+
+                zones.push_back({
+                    event.name.load(std::memory_order_relaxed),
+                    event.start.load(std::memory_order_relaxed),
+                    event.end.load(std::memory_order_relaxed),
+                    ring->thread_id });
+            }
+
+            // zones the owner overwrote while they were being copied
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t after = ring->head.load(std::memory_order_relaxed);
+            uint64_t valid = after >= profile_ring_size ? after - profile_ring_size + 1 : 0;
+
+            if (valid > first)
+            {
+                size_t stale = static_cast<size_t>(std::min(valid, head) - first);
+                zones.erase(
+                    zones.begin() + copied,
+                    zones.begin() + copied + stale);
+            }
+        }
+    }
+
+    std::ofstream os(path);
+
+    if (!os.is_open())
+    {
+        return false;
+    }
+
+    // microseconds, to the nanosecond
+    os.setf(std::ios::fixed);
+    os.precision(3);
+
+    os << "{\"traceEvents\":[\n";
+
+    bool first = true;
+
+    for (const Zone& zone : zones)
+    {
+        if (zone.end < since)
+        {
+            continue;
+        }
+
+        os << (first ? "" : ",\n");
+        os << "{\"name\":\"" << zone.name
+           << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << zone.thread_id
+           << ",\"ts\":" << zone.start / 1000.0
+           << ",\"dur\":" << (zone.end - zone.start) / 1000.0 << "}";
+
+        first = false;
+    }
+
+    os << "\n]}\n";
+
+    return static_cast<bool>(os);
+}
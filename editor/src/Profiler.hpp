@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// zones compile to nothing unless SUPERROCKET_PROFILER is defined
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// PROFILE_BEGIN and PROFILE_END time a span that is not a whole scope
+#if defined (SUPERROCKET_PROFILER)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_BEGIN(zone, name) ProfileZone zone(name)
+#define PROFILE_END(zone) zone.End()
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_BEGIN(zone, name)
+#define PROFILE_END(zone)
+#endif
+
+// one finished zone, in nanoseconds on the profile_now clock
+struct ProfileEvent
+{
+    std::atomic<const char*> name;
+    std::atomic<uint64_t> start;
+    std::atomic<uint64_t> end;
+};
+
+// times the scope it is declared in, name must outlive the profiler
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char* name);
+    ~ProfileZone();
+
+    // records the zone now rather than at the end of the scope
+    void End();
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    const char* name;
+    uint64_t start;
+    bool ended = false;
+};
+
+uint64_t profile_now();
+
+// adds a zone to the calling thread's ring, which keeps the newest
+// profile_ring_size zones and is only ever written by that thread
+void profile_record(const char* name, uint64_t start, uint64_t end);
+
+// frame times are kept for the graph whether or not zones are compiled in,
+// and must be recorded and read from one thread
+void profile_frame(uint64_t start, uint64_t end);
+
+// copies up to max frame times in milliseconds, oldest first
+size_t profile_frame_times(float* times, size_t max);
+
+// writes zones that ended in the last seconds as chrome trace json,
+// viewable in chrome://tracing or perfetto
+bool profile_write_trace(const std::string& path, double seconds);
+
+static const size_t profile_ring_size = 1 << 16;
+static const size_t profile_frame_count = 240;
@@ -0,0 +1,51 @@
+#include "Simd.hpp"
+
+#if defined (SIMD_ARCH_X86) && defined (_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+bool cpu_has_sse2()
+{
+#if defined (SIMD_SSE2)
+    return true;
+#elif defined (SIMD_ARCH_X86) && defined (_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#elif defined (SIMD_ARCH_X86)
+    return __builtin_cpu_supports("sse2");
+#else
+    return false;
+#endif
+}
+
+bool cpu_has_avx2()
+{
+#if defined (SIMD_ARCH_X86) && defined (_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+
+    if (info[0] < 7)
+    {
+        return false;
+    }
+
+    // fma and os support for saving the ymm registers
+    __cpuid(info, 1);
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+
+    if (!fma || !osxsave || (_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined (SIMD_ARCH_X86)
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    return false;
+#endif
+}
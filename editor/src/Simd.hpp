@@ -0,0 +1,15 @@
+#pragma once
+
+#if defined (__x86_64__) || defined (_M_AMD64) || defined (_M_X64) || \
+    defined (__i386__) || defined (_M_IX86)
+#define SIMD_ARCH_X86
+#endif
+
+#if defined (__SSE2__) || defined (_M_AMD64) || defined (_M_X64) || \
+    (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2
+#endif
+
+// runtime cpu feature queries, false on other architectures
+bool cpu_has_sse2();
+bool cpu_has_avx2();
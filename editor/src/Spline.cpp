@@ -1,30 +1,440 @@
 #include "Spline.hpp"
 
+#include "Allocation.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cfloat>
+
+// 5 point Gauss-Legendre rule on [-1, 1]
+static const int gauss_order = 5;
+
+static const float gauss_nodes[gauss_order] = {
+    -0.9061798459386640f,
+    -0.5384693101056831f,
+    0.0f,
+    0.5384693101056831f,
+    0.9061798459386640f };
+
+static const float gauss_weights[gauss_order] = {
+    0.2369268850561891f,
+    0.4786286704993665f,
+    0.5688888888888889f,
+    0.4786286704993665f,
+    0.2369268850561891f };
+
+// speeds sampled at the gauss nodes of an interval, and their integral
+struct GaussSample
+{
+    float speed[gauss_order];
+    float length;
+};
+
+// weights integrating the interpolant of the node samples from the start
+// of the interval to each arc table position inside it
+struct GaussPartialWeights
+{
+    float weights[Spline::arc_samples][gauss_order];
+
+    GaussPartialWeights()
+    {
+        for (size_t j = 0; j < Spline::arc_samples; j++)
+        {
+            // the lagrange basis has degree 4, so the rule itself is exact
+            double b = -1.0 + 2.0 * (j + 1) / Spline::arc_samples;
+            double h = (b + 1.0) / 2.0;
+
+            for (int n = 0; n < gauss_order; n++)
+            {
+                double sum = 0.0;
+
+                for (int m = 0; m < gauss_order; m++)
+                {
+                    double y = -1.0 + h * (gauss_nodes[m] + 1.0);
+                    double basis = 1.0;
+
+                    for (int k = 0; k < gauss_order; k++)
+                    {
+                        if (k != n)
+                        {
+                            basis *=
+                                (y - gauss_nodes[k]) /
+                                (gauss_nodes[n] - gauss_nodes[k]);
+                        }
+                    }
+
+                    sum += gauss_weights[m] * basis;
+                }
+
+                weights[j][n] = static_cast<float>(sum * h);
+            }
+        }
+    }
+};
+
+static GaussSample gauss_sample(
+    const SplineSegment& segment,
+    float t0,
+    float t1)
+{
+    GaussSample sample;
+    float h = (t1 - t0) / 2.0f;
+
+    sample.length = 0.0f;
+
+    for (int n = 0; n < gauss_order; n++)
+    {
+        float t = t0 + h * (gauss_nodes[n] + 1.0f);
+
+        sample.speed[n] = glm::length(
+            segment.Derivative(t));
+
+        sample.length += gauss_weights[n] * sample.speed[n];
+    }
+
+    sample.length *= h;
+
+    return sample;
+}
+
+// writes the arc table entries that fall inside an accepted interval
+static void gauss_fill_arc(
+    const GaussSample& sample,
+    float t0,
+    float t1,
+    float length,
+    float* arc)
+{
+    const size_t n = Spline::arc_samples;
+    static const GaussPartialWeights partial;
+
+    float h = (t1 - t0) / 2.0f;
+    size_t k = static_cast<size_t>(floorf(t0 * n)) + 1;
+
+    for (; static_cast<float>(k) / n < t1; k++)
+    {
+        // table positions inside an interval are multiples of 1 / n
+        size_t j = static_cast<size_t>(
+            roundf((static_cast<float>(k) / n - t0) / (t1 - t0) * n)) - 1;
+
+        float d = 0.0f;
+
+        for (int g = 0; g < gauss_order; g++)
+        {
+            d += partial.weights[j][g] * sample.speed[g];
+        }
+
+        arc[k - 1] = length + d * h;
+    }
+
+    if (static_cast<float>(k) / n == t1)
+    {
+        arc[k - 1] = length + sample.length;
+    }
+}
+
+// deepest split, where intervals are 2^-16 of the segment and halving
+// them no longer changes the float parameters much
+static const int gauss_max_depth = 16;
+
+// adaptive gauss-legendre: split until the halves agree with the whole.
+// near a cusp the speed has a kink, and the two estimates can agree by
+// chance while both are far off, so an interval is only accepted once
+// its parent also came within 16 times the tolerance of its halves. this
+// also means every segment is split at least once.
+static float gauss_integrate(
+    const SplineSegment& segment,
+    float t0,
+    float t1,
+    const GaussSample& whole,
+    float parent_error,
+    float tolerance,
+    int depth,
+    float length,
+    float* arc)
+{
+    float tm = (t0 + t1) / 2.0f;
+
+    GaussSample left = gauss_sample(segment, t0, tm);
+    GaussSample right = gauss_sample(segment, tm, t1);
+
+    float error = fabsf(left.length + right.length - whole.length);
+
+    bool converged = error <= tolerance && parent_error <= 16.0f * tolerance;
+
+    if (converged || depth >= gauss_max_depth)
+    {
+        if (arc != nullptr)
+        {
+            gauss_fill_arc(left, t0, tm, length, arc);
+            gauss_fill_arc(right, tm, t1, length + left.length, arc);
+        }
+
+        return left.length + right.length;
+    }
+
+    float l = gauss_integrate(
+        segment, t0, tm, left, error, tolerance / 2.0f, depth + 1, length, arc);
+
+    float r = gauss_integrate(
+        segment, tm, t1, right, error, tolerance / 2.0f, depth + 1, length + l, arc);
+
+    return l + r;
+}
+
+// length of a whole segment, filling its arc table
+static float segment_length(
+    const SplineSegment& segment,
+    float tolerance,
+    float* arc)
+{
+    GaussSample whole = gauss_sample(segment, 0.0f, 1.0f);
+
+    return gauss_integrate(
+        segment,
+        0.0f,
+        1.0f,
+        whole,
+        FLT_MAX,
+        tolerance * whole.length,
+        0,
+        0.0f,
+        arc);
+}
+
+// bernstein to power basis, and the hull of the control points
+static void segment_coefficients(
+    const SplineNode& node,
+    const SplineNode& next,
+    SplineSegment& segment,
+    Aabb& box)
+{
+    vec4 p0 = vec4(node.point, 0.0f);
+    vec4 p1 = vec4(node.point + node.control, 0.0f);
+    vec4 p2 = vec4(next.point - next.control, 0.0f);
+    vec4 p3 = vec4(next.point, 0.0f);
+
+    // taken from the controls and the chord rather than the control
+    // points, which far from the origin would round away the low bits
+    // of short controls
+    vec4 a = vec4(node.control, 0.0f);
+    vec4 b = vec4(next.control, 0.0f);
+    vec4 chord = vec4(next.point - node.point, 0.0f);
+
+    segment.c[0] = p0;
+    segment.c[1] = 3.0f * a;
+    segment.c[2] = 3.0f * (chord - b - 2.0f * a);
+    segment.c[3] = 3.0f * (a + b) - 2.0f * chord;
+
+    // the curve lies inside the hull of its control points
+    box = Aabb();
+    box.Extend(vec3(p0));
+    box.Extend(vec3(p1));
+    box.Extend(vec3(p2));
+    box.Extend(vec3(p3));
+}
+
+// box around the point, control and normal handles of a node, as they
+// are drawn and picked
+static Aabb node_box(const SplineNode& node)
+{
+    Aabb box;
+    box.Extend(node.point);
+    box.Extend(node.point + node.control);
+    box.Extend(node.point + node.normal * 0.5f);
+
+    return box;
+}
+
+// unit tangent at t, keeping the previous one where the curve stalls
+static vec3 segment_tangent(
+    const SplineSegment& segment,
+    float t,
+    vec3 previous)
+{
+    vec3 d = segment.Derivative(t);
+    float length = glm::length(d);
+
+    return length > 1e-6f ? d / length : previous;
+}
+
+// the part of n at right angles to the unit tangent t, or any direction
+// at right angles to t when n is parallel to it
+static vec3 perpendicular(vec3 n, vec3 t)
+{
+    vec3 r = n - t * glm::dot(n, t);
+    float length = glm::length(r);
+
+    if (length < 1e-6f)
+    {
+        r = glm::cross(t, fabsf(t.y) < 0.9f ? vec3(0, 1, 0) : vec3(1, 0, 0));
+        length = glm::length(r);
+    }
+
+    return r / length;
+}
+
+// the start normal is carried along the segment by double reflection
+// (wang et al. 2008), which adds no twist of its own. the roll between
+// where it arrives and the normal at the far node is then spread evenly
+// over the segment, so frames meet at every node.
+static void segment_frames(
+    const SplineSegment& segment,
+    const SplineNode& node,
+    const SplineNode& next,
+    quat* frames)
+{
+    // reflection steps between stored frames
+    const size_t steps = 4;
+    const size_t n = Spline::frame_samples * steps;
+
+    vec3 chord = next.point - node.point;
+    vec3 fallback = glm::length(chord) > 1e-6f ? glm::normalize(chord) : vec3(0, 0, 1);
+
+    vec3 x[n + 1];
+    vec3 t[n + 1];
+    vec3 r[n + 1];
+
+    for (size_t k = 0; k <= n; k++)
+    {
+        float u = static_cast<float>(k) / n;
+        x[k] = segment.Point(u);
+        t[k] = segment_tangent(segment, u, k > 0 ? t[k - 1] : fallback);
+    }
+
+    r[0] = perpendicular(node.normal, t[0]);
+
+    for (size_t k = 0; k < n; k++)
+    {
+        vec3 v1 = x[k + 1] - x[k];
+        float c1 = glm::dot(v1, v1);
+
+        if (c1 < 1e-12f)
+        {
+            r[k + 1] = perpendicular(r[k], t[k + 1]);
+            continue;
+        }
+
+        vec3 rl = r[k] - v1 * (2.0f / c1 * glm::dot(v1, r[k]));
+        vec3 tl = t[k] - v1 * (2.0f / c1 * glm::dot(v1, t[k]));
+
+        vec3 v2 = t[k + 1] - tl;
+        float c2 = glm::dot(v2, v2);
+
+        vec3 reflected = c2 < 1e-12f ? rl : rl - v2 * (2.0f / c2 * glm::dot(v2, rl));
+        r[k + 1] = perpendicular(reflected, t[k + 1]);
+    }
+
+    vec3 target = perpendicular(next.normal, t[n]);
+    float roll = atan2f(
+        glm::dot(glm::cross(r[n], target), t[n]),
+        glm::dot(r[n], target));
+
+    for (size_t k = 0; k < Spline::frame_samples; k++)
+    {
+        size_t j = k * steps;
+        float angle = roll * k / Spline::frame_samples;
+
+        vec3 normal = r[j] * cosf(angle) + glm::cross(t[j], r[j]) * sinf(angle);
+        mat3 basis(glm::cross(normal, t[j]), normal, t[j]);
+
+        frames[k] = glm::normalize(glm::quat_cast(basis));
+    }
+}
+
+// segment of a chunk holding a distance, given the distance at its start
+static size_t find_slot(
+    const SplineNodes::Chunk& chunk,
+    double start,
+    double distance)
+{
+    auto segment = std::upper_bound(
+        chunk.offsets.begin() + 1,
+        chunk.offsets.end(),
+        distance,
+        [start](double d, double offset)
+    {
+        return d < start + offset;
+    });
+
+    return static_cast<size_t>(segment - chunk.offsets.begin()) - 1;
+}
+
+// parameter of a distance d into a segment with the given arc table
+static float arc_parameter(const float* arc, float d)
+{
+    // arc-length sample containing d within the segment
+    size_t k = static_cast<size_t>(
+        std::lower_bound(arc, arc + Spline::arc_samples - 1, d) - arc);
+
+    float d0 = k > 0 ? arc[k - 1] : 0.0f;
+    float d1 = arc[k];
+    float s = d1 > d0 ? (d - d0) / (d1 - d0) : 0.0f;
+    s = glm::clamp(s, 0.0f, 1.0f);
+
+    return (k + s) / Spline::arc_samples;
+}
+
 void Spline::RecalculateControls(size_t i)
 {
     size_t prev = GetIndex(i - 1);
     size_t curr = GetIndex(i);
     size_t next = GetIndex(i + 1);
 
-    vec3 p_prev = points[prev];
-    vec3 p_curr = points[curr];
-    vec3 p_next = points[next];
+    vec3 p_prev = Node(prev).point;
+    vec3 p_curr = Node(curr).point;
+    vec3 p_next = Node(next).point;
 
     vec3 d0 = p_curr - p_prev;
     vec3 d1 = p_next - p_curr;
+    vec3 d = (d0 + d1) / 2.0f;
+
+    // with two nodes both neighbours are the other one and the sum is
+    // zero, so the control points along the chord to the next node
+    if (count < 3 || glm::dot(d, d) < 1e-12f)
+    {
+        d = d1;
+    }
 
-    vec3 d = glm::normalize((d0 + d1) / 2.0f);
+    // a node on top of its neighbours keeps the control it has
+    if (glm::dot(d, d) < 1e-12f)
+    {
+        return;
+    }
 
-    controls[curr] = d;
+    SplineNode node = Node(curr);
+    node.control = glm::normalize(d);
+
+    StoreNode(curr, node);
+    MarkDirty(curr);
+}
+
+void Spline::InsertFitted(size_t index, vec3 position, vec3 normal)
+{
+    SplineNode node;
+    node.point = position;
+    node.normal = normal;
+    InsertNode(index, node);
+
+    // only the new node's control, its neighbours keep their shape. a
+    // lone node has nothing to point at.
+    if (count > 1)
+    {
+        RecalculateControls(index);
+    }
 }
 
 void Spline::InsertPoint(vec3 position)
 {
-    points.push_back(position);
-    controls.push_back(vec3());
-    normals.push_back(vec3(0, 1, 0));
+    ALLOCATION_TAG(AllocationTag::SPLINE);
+
+    BeginEdit();
 
-    size_t i = count = points.size();
+    SplineNode node;
+    node.point = position;
+    InsertNode(count, node);
+
+    size_t i = count;
 
     if (i > 1)
     {
@@ -33,33 +443,222 @@ void Spline::InsertPoint(vec3 position)
         RecalculateControls(i);
     }
 
+    Notify({ SplineEditType::INSERT_POINT, i - 1, position });
+    EndEdit();
+}
+
+void Spline::InsertPointAfter(size_t index, vec3 position)
+{
+    ALLOCATION_TAG(AllocationTag::SPLINE);
+
+    BeginEdit();
+
+    InsertFitted(index + 1, position, Node(index).normal);
+
+    Notify({ SplineEditType::INSERT_POINT_AFTER, index, position });
+    EndEdit();
+}
+
+void Spline::DeletePoint(size_t index)
+{
+    ALLOCATION_TAG(AllocationTag::SPLINE);
+
+    BeginEdit();
+
+    vec3 position = Node(index).point;
+    EraseNode(index);
+
+    Notify({ SplineEditType::DELETE_POINT, index, position });
+    EndEdit();
+}
+
+void Spline::InsertPointOnCurve(size_t index, float t)
+{
+    ALLOCATION_TAG(AllocationTag::SPLINE);
+
+    BeginEdit();
+
+    // the segment and its frames must be current to be read
     Update();
+
+    const SplineSegment& segment = Segment(index);
+
+    // an exact de casteljau split would give the new node t and 1 - t of
+    // the tangent on either side, and scale both neighbours' controls,
+    // which are shared with the segments beyond them. a node has only one
+    // control, so it takes the average of the two halves and the
+    // neighbours are left alone.
+    SplineNode node;
+    node.point = segment.Point(t);
+    node.control = segment.Derivative(t) / 6.0f;
+    node.normal = GetFrame(index, t) * vec3(0, 1, 0);
+
+    InsertNode(index + 1, node);
+
+    Notify({ SplineEditType::INSERT_POINT_ON_CURVE, index, vec3(t, 0, 0) });
+    EndEdit();
 }
 
 void Spline::MovePoint(size_t index, vec3 position)
 {
-    vec3 offset = position - points[index];
-    points[index] += offset;
+    BeginEdit();
 
-    Update();
+    SplineNode node = Node(index);
+    vec3 offset = position - node.point;
+    node.point += offset;
+
+    StoreNode(index, node);
+    MarkDirty(index);
+    Notify({ SplineEditType::MOVE_POINT, index, position });
+    EndEdit();
 }
 
 void Spline::MoveControl(size_t index, vec3 position)
 {
-    vec3 point = points[index];
+    BeginEdit();
 
-    controls[index] = position - point;
+    SplineNode node = Node(index);
+    node.control = position - node.point;
 
-    Update();
+    StoreNode(index, node);
+    MarkDirty(index);
+    Notify({ SplineEditType::MOVE_CONTROL, index, position });
+    EndEdit();
 }
 
 void Spline::MoveNormal(size_t index, vec3 position)
 {
-    vec3 point = points[index];
+    BeginEdit();
 
-    normals[index] = glm::normalize(position - point);
+    SplineNode node = Node(index);
 
-    Update();
+    // normals do not affect the shape, only the frames need updating
+    node.normal = glm::normalize(position - node.point);
+
+    StoreNode(index, node);
+    MarkFramesDirty(index);
+    Notify({ SplineEditType::MOVE_NORMAL, index, position });
+    EndEdit();
+}
+
+void Spline::SetPoint(size_t index, vec3 point)
+{
+    BeginEdit();
+
+    SplineNode node = Node(index);
+    node.point = point;
+
+    StoreNode(index, node);
+    MarkDirty(index);
+    Notify({ SplineEditType::SET_POINT, index, point });
+    EndEdit();
+}
+
+void Spline::SetControl(size_t index, vec3 control)
+{
+    BeginEdit();
+
+    SplineNode node = Node(index);
+    node.control = control;
+
+    StoreNode(index, node);
+    MarkDirty(index);
+    Notify({ SplineEditType::SET_CONTROL, index, control });
+    EndEdit();
+}
+
+void Spline::SetNormal(size_t index, vec3 normal)
+{
+    BeginEdit();
+
+    SplineNode node = Node(index);
+    node.normal = normal;
+
+    StoreNode(index, node);
+    MarkFramesDirty(index);
+    Notify({ SplineEditType::SET_NORMAL, index, normal });
+    EndEdit();
+}
+
+void Spline::InsertPointBefore(size_t index, vec3 position)
+{
+    ALLOCATION_TAG(AllocationTag::SPLINE);
+
+    BeginEdit();
+
+    InsertFitted(
+        index,
+        position,
+        count > 0 ? Node(std::min(index, count - 1)).normal : vec3(0, 1, 0));
+
+    Notify({ SplineEditType::INSERT_POINT_BEFORE, index, position });
+    EndEdit();
+}
+
+void Spline::Apply(const SplineEdit& edit)
+{
+    switch (edit.type)
+    {
+        case SplineEditType::INSERT_POINT:
+            InsertPoint(edit.position);
+            break;
+        case SplineEditType::MOVE_POINT:
+            MovePoint(edit.index, edit.position);
+            break;
+        case SplineEditType::MOVE_CONTROL:
+            MoveControl(edit.index, edit.position);
+            break;
+        case SplineEditType::MOVE_NORMAL:
+            MoveNormal(edit.index, edit.position);
+            break;
+        case SplineEditType::INSERT_POINT_AFTER:
+            InsertPointAfter(edit.index, edit.position);
+            break;
+        case SplineEditType::DELETE_POINT:
+            DeletePoint(edit.index);
+            break;
+        case SplineEditType::INSERT_POINT_ON_CURVE:
+            InsertPointOnCurve(edit.index, edit.position.x);
+            break;
+        case SplineEditType::SET_POINT:
+            SetPoint(edit.index, edit.position);
+            break;
+        case SplineEditType::SET_CONTROL:
+            SetControl(edit.index, edit.position);
+            break;
+        case SplineEditType::SET_NORMAL:
+            SetNormal(edit.index, edit.position);
+            break;
+        case SplineEditType::INSERT_POINT_BEFORE:
+            InsertPointBefore(edit.index, edit.position);
+            break;
+    }
+}
+
+void Spline::AddListener(SplineListener listener)
+{
+    listeners.push_back(listener);
+}
+
+void Spline::Notify(const SplineEdit& edit)
+{
+    for (auto& listener : listeners)
+    {
+        listener(edit);
+    }
+}
+
+void Spline::AddNodeListener(SplineNodeListener listener)
+{
+    node_listeners.push_back(listener);
+}
+
+void Spline::NotifyNode(const SplineNodeChange& change)
+{
+    for (auto& listener : node_listeners)
+    {
+        listener(change);
+    }
 }
 
 size_t Spline::GetIndex(size_t i)
@@ -67,122 +666,617 @@ size_t Spline::GetIndex(size_t i)
     return ((i % count) + count) % count;
 }
 
-void Spline::Update()
+size_t Spline::Find(NodeHandle handle) const
+{
+    return nodes.Find(handle);
+}
+
+void Spline::BeginEdit()
+{
+    edit_depth++;
+}
+
+void Spline::EndEdit()
+{
+    if (edit_depth > 0 && --edit_depth == 0)
+    {
+        Update();
+    }
+}
+
+void Spline::MarkDirty(size_t node)
+{
+    // a node is shared by the segment ending and the segment starting at it
+    size_t n = count;
+    revision++;
+    dirty_segments.push_back(nodes.Handle((node + n - 1) % n));
+    dirty_segments.push_back(nodes.Handle(node % n));
+}
+
+void Spline::MarkFramesDirty(size_t node)
+{
+    size_t n = count;
+    revision++;
+    dirty_frames.push_back(nodes.Handle((node + n - 1) % n));
+    dirty_frames.push_back(nodes.Handle(node % n));
+}
+
+void Spline::Invalidate()
+{
+    revision++;
+    invalid = true;
+    dirty_segments.clear();
+    dirty_frames.clear();
+}
+
+const SplineNode& Spline::Node(size_t i) const
+{
+    return nodes.Get(i);
+}
+
+NodeHandle Spline::Handle(size_t i) const
+{
+    return nodes.Handle(i);
+}
+
+const SplineSegment& Spline::Segment(size_t i) const
+{
+    size_t first = 0;
+    size_t c = nodes.Locate(i, first);
+
+    return nodes.Chunks()[c]->segments[i - first];
+}
+
+float Spline::Length(size_t i) const
+{
+    size_t first = 0;
+    size_t c = nodes.Locate(i, first);
+
+    return nodes.Chunks()[c]->lengths[i - first];
+}
+
+const float* Spline::ArcLengths(size_t i) const
+{
+    size_t first = 0;
+    size_t c = nodes.Locate(i, first);
+
+    return &nodes.Chunks()[c]->arc_lengths[(i - first) * arc_samples];
+}
+
+const quat* Spline::Frames(size_t i) const
+{
+    size_t first = 0;
+    size_t c = nodes.Locate(i, first);
+
+    return &nodes.Chunks()[c]->frames[(i - first) * frame_samples];
+}
+
+const Aabb& Spline::Bounds(size_t i) const
+{
+    size_t first = 0;
+    size_t c = nodes.Locate(i, first);
+
+    return nodes.Chunks()[c]->bounds.GetLeaf(i - first);
+}
+
+void Spline::Cull(
+    const Frustum& frustum,
+    float margin,
+    bool ground,
+    std::vector<size_t>& visible) const
+{
+    nodes.Cull(frustum, margin, ground, visible);
+}
+
+void Spline::InsertNode(size_t index, const SplineNode& node)
+{
+    // one chunk makes room for the node, and splits in two when full
+    nodes.Insert(index, node);
+
+    count = nodes.Size();
+
+    // the segment before now ends at the new node
+    MarkDirty(index);
+    NotifyNode({ SplineNodeChangeType::INSERT, index, node, node });
+}
+
+void Spline::EraseNode(size_t index)
+{
+    SplineNode node = nodes.Get(index);
+    nodes.Erase(index);
+
+    count = nodes.Size();
+
+    // the segment before now leads to the node after
+    if (count > 0)
+    {
+        MarkDirty(index % count);
+    }
+    else
+    {
+        revision++;
+        dirty_segments.clear();
+        dirty_frames.clear();
+        total_length = 0.0f;
+    }
+
+    NotifyNode({ SplineNodeChangeType::ERASE, index, node, node });
+}
+
+void Spline::StoreNode(size_t index, const SplineNode& node)
 {
-    count = points.size();
-    lengths.resize(count);
+    SplineNodeChange change = { SplineNodeChangeType::SET, index, nodes.Get(index), node };
+    nodes.Set(index, node);
+
+    NotifyNode(change);
+}
 
+void Spline::Assign(
+    const vec3* points,
+    const vec3* controls,
+    const vec3* normals,
+    size_t n)
+{
+    ALLOCATION_TAG(AllocationTag::SPLINE);
+
+    nodes.Assign(points, controls, normals, n);
+
+    count = n;
     total_length = 0.0f;
 
-    for (int i = 0; i < lengths.size(); i++)
+    Invalidate();
+}
+
+void Spline::RestoreNodes(const std::vector<std::shared_ptr<const SplineNodes::Chunk>>& chunks)
+{
+    ALLOCATION_TAG(AllocationTag::SPLINE);
+
+    // the chunks were kept with their segments current
+    nodes.Restore(chunks);
+
+    count = nodes.Size();
+    total_length = static_cast<float>(nodes.Length());
+    invalid = false;
+    dirty_segments.clear();
+    dirty_frames.clear();
+
+    revision++;
+}
+
+// indices of the nodes still there, sorted without repeats
+void Spline::FindDirty(
+    const std::vector<NodeHandle>& handles,
+    std::vector<size_t>& indices) const
+{
+    indices.clear();
+
+    for (NodeHandle handle : handles)
     {
-        total_length += (lengths[i] = CalculateSegmentLength(i));
+        size_t i = nodes.Find(handle);
+
+        if (i < count)
+        {
+            indices.push_back(i);
+        }
     }
+
+    std::sort(indices.begin(), indices.end());
+    indices.erase(
+        std::unique(indices.begin(), indices.end()),
+        indices.end());
 }
 
-vec3 Spline::GetPoint(float f)
+void Spline::Update()
 {
-    size_t i = static_cast<size_t>(f);
-    size_t i0 = i;
-    size_t i1 = (i + 1) % count;
+    PROFILE_ZONE("Spline::Update");
+    ALLOCATION_TAG(AllocationTag::SPLINE);
 
-    float t = f - i;
-    float c = 1.0f - t;
+    if (invalid)
+    {
+        Prepare();
+        IntegrateAll();
+        nodes.RefreshAll();
+        total_length = static_cast<float>(nodes.Length());
+        return;
+    }
+
+    if (dirty_segments.empty() && dirty_frames.empty())
+    {
+        return;
+    }
+
+    FindDirty(dirty_segments, shape_nodes);
+    FindDirty(dirty_frames, frame_nodes);
+
+    dirty_segments.clear();
+    dirty_frames.clear();
 
-    float bb0 = c * c * c;
-    float bb1 = 3 * t * c * c;
-    float bb2 = 3 * t * t * c;
-    float bb3 = t * t * t;
+    // frames follow the shape as well as the normals
+    frame_nodes.insert(
+        frame_nodes.end(),
+        shape_nodes.begin(),
+        shape_nodes.end());
 
-    i0 %= points.size();
-    i1 %= points.size();
+    std::sort(frame_nodes.begin(), frame_nodes.end());
+    frame_nodes.erase(
+        std::unique(frame_nodes.begin(), frame_nodes.end()),
+        frame_nodes.end());
 
-    vec3 p0 = points[i0];
-    vec3 p1 = points[i0] + controls[i0];
-    vec3 p2 = points[i1] - controls[i1];
-    vec3 p3 = points[i1];
+    work.clear();
+    work_chunks.clear();
 
-    vec3 point =
-        p0 * bb0 +
-        p1 * bb1 +
-        p2 * bb2 +
-        p3 * bb3;
+    SplineNodes::Chunk* chunk = nullptr;
+    size_t first = 0;
+    size_t end = 0;
+    size_t shape = 0;
 
-    return point;
+    // the nodes are sorted, so each chunk is found and written once
+    for (size_t i : frame_nodes)
+    {
+        if (chunk == nullptr || i >= end)
+        {
+            size_t c = nodes.Locate(i, first);
+            chunk = &nodes.Write(c);
+            end = first + chunk->Size();
+            work_chunks.push_back(c);
+        }
+
+        SplineSegmentWork segment;
+        segment.chunk = chunk;
+        segment.slot = i - first;
+        segment.next = nodes.Get((i + 1) % count);
+        segment.shape = shape < shape_nodes.size() && shape_nodes[shape] == i;
+
+        if (segment.shape)
+        {
+            Aabb box;
+            segment_coefficients(
+                chunk->nodes[segment.slot],
+                segment.next,
+                chunk->segments[segment.slot],
+                box);
+
+            chunk->bounds.SetLeaf(segment.slot, box);
+            shape++;
+        }
+
+        chunk->node_bounds.SetLeaf(segment.slot, node_box(chunk->nodes[segment.slot]));
+        work.push_back(segment);
+    }
+
+    // each segment only reads its own coefficients and nodes
+    JobSystem::Default().ParallelFor(
+        work.size(),
+        parallel_grain,
+        [this](size_t first, size_t last)
+    {
+        for (size_t k = first; k < last; k++)
+        {
+            SplineSegmentWork& w = work[k];
+            SplineNodes::Chunk& chunk = *w.chunk;
+            const SplineSegment& segment = chunk.segments[w.slot];
+
+            if (w.shape)
+            {
+                chunk.lengths[w.slot] = segment_length(
+                    segment,
+                    length_tolerance,
+                    &chunk.arc_lengths[w.slot * arc_samples]);
+            }
+
+            segment_frames(
+                segment,
+                chunk.nodes[w.slot],
+                w.next,
+                &chunk.frames[w.slot * frame_samples]);
+        }
+    });
+
+    // only the edited chunks sum their offsets again, and the chunk tree
+    // above them
+    for (size_t c : work_chunks)
+    {
+        nodes.Refresh(c);
+    }
+
+    total_length = static_cast<float>(nodes.Length());
 }
 
-vec3 Spline::GetGradient(float f)
+void Spline::Restore(const float* lengths, const float* arc_lengths)
 {
-    size_t i = static_cast<size_t>(f);
-    size_t i0 = i;
-    size_t i1 = (i + 1) % count;
+    Prepare();
 
-    float t = f - i;
+    const auto& chunks = nodes.Chunks();
 
-    vec3 p0 = points[i0];
-    vec3 p1 = points[i0] + controls[i0];
-    vec3 p2 = points[i1] - controls[i1];
-    vec3 p3 = points[i1];
+    JobSystem::Default().ParallelFor(
+        chunks.size(),
+        1,
+        [this, lengths, arc_lengths](size_t first, size_t last)
+    {
+        for (size_t c = first; c < last; c++)
+        {
+            UpdateChunk(c, lengths, arc_lengths);
+        }
+    });
 
-    vec3 q0 = p0 + ((p1 - p0) * t);
-    vec3 q1 = p1 + ((p2 - p1) * t);
-    vec3 q2 = p2 + ((p3 - p2) * t);
+    Finish();
+}
+
+void Spline::Prepare()
+{
+    count = nodes.Size();
+
+    size_t first = 0;
+
+    for (size_t c = 0; c < nodes.Chunks().size(); c++)
+    {
+        SplineNodes::Chunk& chunk = nodes.Write(c);
+        size_t n = chunk.Size();
+
+        for (size_t slot = 0; slot < n; slot++)
+        {
+            const SplineNode& next = slot + 1 < n ?
+                chunk.nodes[slot + 1] : nodes.Get((first + n) % count);
+
+            Aabb box;
+            segment_coefficients(chunk.nodes[slot], next, chunk.segments[slot], box);
+
+            chunk.bounds.SetLeaf(slot, box);
+            chunk.node_bounds.SetLeaf(slot, node_box(chunk.nodes[slot]));
+        }
+
+        first += n;
+    }
+
+    dirty_segments.clear();
+    dirty_frames.clear();
+    invalid = false;
+    revision++;
+}
 
-    vec3 r0 = q0 + ((q1 - q0) * t);
-    vec3 r1 = q1 + ((q2 - q1) * t);
-    vec3 tangent = r1 - r0;
+// integrates every segment of a chunk and rebuilds its frames, or takes
+// the lengths and arc tables given for the whole spline
+void Spline::UpdateChunk(
+    size_t c,
+    const float* lengths,
+    const float* arc_lengths)
+{
+    // Prepare wrote every chunk, so this copies nothing and concurrent
+    // calls only touch their own chunks
+    SplineNodes::Chunk& chunk = nodes.Write(c);
+    size_t first = nodes.First(c);
+    size_t n = chunk.Size();
+
+    for (size_t slot = 0; slot < n; slot++)
+    {
+        const SplineSegment& segment = chunk.segments[slot];
+        float* arc = &chunk.arc_lengths[slot * arc_samples];
+
+        if (lengths != nullptr)
+        {
+            size_t i = first + slot;
+            chunk.lengths[slot] = lengths[i];
+            std::copy(arc_lengths + i * arc_samples, arc_lengths + (i + 1) * arc_samples, arc);
+        }
+        else
+        {
+            chunk.lengths[slot] = segment_length(segment, length_tolerance, arc);
+        }
 
-    return tangent;
+        const SplineNode& next = slot + 1 < n ?
+            chunk.nodes[slot + 1] : nodes.Get((first + n) % count);
+
+        segment_frames(segment, chunk.nodes[slot], next, &chunk.frames[slot * frame_samples]);
+    }
+}
+
+void Spline::IntegrateChunk(size_t c)
+{
+    UpdateChunk(c, nullptr, nullptr);
+}
+
+void Spline::IntegrateAll()
+{
+    // chunks already hold a few hundred segments each
+    JobSystem::Default().ParallelFor(
+        nodes.Chunks().size(),
+        1,
+        [this](size_t first, size_t last)
+    {
+        for (size_t c = first; c < last; c++)
+        {
+            IntegrateChunk(c);
+        }
+    });
+}
+
+void Spline::Finish()
+{
+    nodes.RefreshAll();
+    total_length = static_cast<float>(nodes.Length());
+
+    NotifyNode({ SplineNodeChangeType::RESET, 0, SplineNode(), SplineNode() });
+}
+
+void Spline::Rebuild()
+{
+    PROFILE_ZONE("Spline::Rebuild");
+    ALLOCATION_TAG(AllocationTag::SPLINE);
+
+    Prepare();
+    IntegrateAll();
+    Finish();
+}
+
+vec3 Spline::GetPoint(float f)
+{
+    size_t i = static_cast<size_t>(f);
+    return GetPoint(i % count, f - i);
+}
+
+vec3 Spline::GetGradient(float f)
+{
+    size_t i = static_cast<size_t>(f);
+    return GetGradient(i % count, f - i);
 }
 
 vec3 Spline::GetNormal(float f)
 {
     size_t i = static_cast<size_t>(f);
-    size_t i0 = i;
-    size_t i1 = (i + 1) % count;
+    return GetNormal(i % count, f - i);
+}
+
+quat Spline::GetFrame(float f)
+{
+    size_t i = static_cast<size_t>(f);
+    return GetFrame(i % count, f - i);
+}
 
+vec3 Spline::GetPoint(size_t i, float t) const
+{
+    return Segment(i).Point(t);
+}
+
+vec3 Spline::GetGradient(size_t i, float t) const
+{
+    // a third of the derivative, matching the de casteljau construction
+    return Segment(i).Derivative(t) * (1.0f / 3.0f);
+}
+
+vec3 Spline::GetNormal(size_t i, float t) const
+{
+    return GetFrame(i, t) * vec3(0, 1, 0);
+}
+
+quat Spline::GetFrame(size_t i, float t) const
+{
+    float s = t * frame_samples;
+    size_t k = std::min(static_cast<size_t>(s), frame_samples - 1);
+    const quat* frames = Frames(i);
+
+    // the last frame of a segment leads into the first of the next
+    quat q1 = k + 1 < frame_samples ? frames[k + 1] : Frames((i + 1) % count)[0];
+
+    return FrameSlerp(frames[k], q1).At(s - k);
+}
+
+float Spline::GetCurvature(float f)
+{
+    size_t i = static_cast<size_t>(f);
     float t = f - i;
 
-    vec3 p0 = glm::normalize(controls[i0]);
-    vec3 p1 = glm::normalize(controls[i1]);
+    const SplineSegment& segment = Segment(i % count);
+    vec3 d1 = segment.Derivative(t);
+    vec3 d2 = segment.SecondDerivative(t);
+
+    float speed = glm::length(d1);
+
+    if (speed <= 0.0f)
+    {
+        return 0.0f;
+    }
 
-    float d0 = glm::dot(p0, normals[i0]);
-    float d1 = glm::dot(p1, normals[i1]);
+    return glm::length(glm::cross(d1, d2)) / (speed * speed * speed);
+}
 
-    vec3 n0 = glm::normalize(normals[i0] - (p0 * d0));
-    vec3 n1 = glm::normalize(normals[i1] - (p1 * d1));
+float Spline::CalculateArcLength(int node, float t0, float t1)
+{
+    const SplineSegment& segment = Segment(node);
+    GaussSample whole = gauss_sample(segment, t0, t1);
 
-    return glm::normalize(n0 * (1 - t) + n1 * t);
+    return gauss_integrate(
+        segment,
+        t0,
+        t1,
+        whole,
+        FLT_MAX,
+        length_tolerance * whole.length,
+        0,
+        0.0f,
+        nullptr);
 }
 
 float Spline::CalculateSegmentLength(int node)
 {
-    float length = 0.0f;
-    float step_size = 0.005f;
+    return CalculateArcLength(node, 0.0f, 1.0f);
+}
+
+float Spline::GetNormalisedOffset(float p)
+{
+    if (count == 0)
+    {
+        return 0.0f;
+    }
+
+    float t = 0.0f;
+    size_t i = FindParameter(p, t);
+
+    return static_cast<float>(i) + t;
+}
+
+size_t Spline::FindParameter(double distance, float& t) const
+{
+    // the chunk and segment holding the distance, then the arc table
+    // inside it
+    size_t first = 0;
+    double start = 0.0;
+    size_t c = nodes.LocateDistance(distance, first, start);
+
+    const SplineNodes::Chunk& chunk = *nodes.Chunks()[c];
+    size_t slot = find_slot(chunk, start, distance);
+    float d = static_cast<float>(distance - (start + chunk.offsets[slot]));
 
-    vec3 old_point, new_point;
-    old_point = GetPoint(static_cast<float>(node));
+    t = arc_parameter(&chunk.arc_lengths[slot * arc_samples], d);
 
-    for (float t = 0; t < 1.0f; t += step_size)
+    return first + slot;
+}
+
+float Spline::GetSegmentOffset(size_t i, float d)
+{
+    return arc_parameter(ArcLengths(i), d);
+}
+
+float Spline::GetDistance(float f)
+{
+    if (count == 0)
     {
-        new_point = GetPoint(static_cast<float>(node) + t);
-        length += sqrtf(
-            (new_point.x - old_point.x) * (new_point.x - old_point.x) +
-            (new_point.y - old_point.y) * (new_point.y - old_point.y) +
-            (new_point.z - old_point.z) * (new_point.z - old_point.z));
-        old_point = new_point;
+        return 0.0f;
     }
 
-    return length;
+    size_t i = static_cast<size_t>(f);
+    float t = f - i;
+    i %= count;
+
+    float a = t * arc_samples;
+    size_t k = static_cast<size_t>(a);
+    k = k < arc_samples ? k : arc_samples - 1;
+
+    const float* arc = ArcLengths(i);
+    float d0 = k > 0 ? arc[k - 1] : 0.0f;
+    float d1 = arc[k];
+
+    return static_cast<float>(Offset(i) + d0 + (d1 - d0) * (a - k));
 }
 
-float Spline::GetNormalisedOffset(float p)
+double Spline::Offset(size_t i) const
 {
-    int i = 0;
-    while (p > lengths[i])
+    if (i >= count)
     {
-        p -= lengths[i];
-        i++;
+        return nodes.Length();
     }
-    return static_cast<float>(i) + (p / lengths[i]);
+
+    size_t first = 0;
+    size_t c = nodes.Locate(i, first);
+
+    return nodes.Start(c) + nodes.Chunks()[c]->offsets[i - first];
+}
+
+size_t Spline::FindSegment(double distance) const
+{
+    // the chunk holding the distance, then the segment inside it
+    size_t first = 0;
+    double start = 0.0;
+    size_t c = nodes.LocateDistance(distance, first, start);
+
+    return first + find_slot(*nodes.Chunks()[c], start, distance);
 }
@@ -1,30 +1,264 @@
 #pragma once
 
 #include "Math.hpp"
+#include "Culling.hpp"
+#include "Jobs.hpp"
+#include "SplineBatch.hpp"
+#include "SplineNodes.hpp"
 
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <vector>
 
+enum class SplineEditType : uint32_t
+{
+    INSERT_POINT,
+    MOVE_POINT,
+    MOVE_CONTROL,
+    MOVE_NORMAL,
+    INSERT_POINT_AFTER,
+    DELETE_POINT,
+    INSERT_POINT_ON_CURVE,
+    SET_POINT,
+    SET_CONTROL,
+    SET_NORMAL,
+    INSERT_POINT_BEFORE
+};
+
+// one edit made through the Spline interface, with the arguments needed
+// to apply it again. an insert on the curve keeps its parameter in
+// position.x, and the
+// set edits hold the stored value itself so applying them again is exact.
+struct SplineEdit
+{
+    SplineEditType type;
+    size_t index;
+    vec3 position;
+};
+
+using SplineListener = std::function<void(const SplineEdit&)>;
+
+enum class SplineNodeChangeType
+{
+    SET,
+    INSERT,
+    ERASE,
+    RESET
+};
+
+// one node written, inserted or erased by an edit, with its value before
+// and after. a reset replaces every node without saying which.
+struct SplineNodeChange
+{
+    SplineNodeChangeType type;
+    size_t index;
+    SplineNode before;
+    SplineNode after;
+};
+
+using SplineNodeListener = std::function<void(const SplineNodeChange&)>;
+
+// a segment Update is rebuilding, with the chunk it is kept in and a
+// copy of the node it ends at
+struct SplineSegmentWork
+{
+    SplineNodes::Chunk* chunk;
+    size_t slot;
+    SplineNode next;
+
+    // false when only the frames are rebuilt
+    bool shape;
+};
+
 class Spline
 {
 public:
+    // number of arc-length samples stored per segment
+    static const size_t arc_samples = SplineNodes::arc_samples;
+
+    // number of frames stored per segment
+    static const size_t frame_samples = SplineNodes::frame_samples;
+
     size_t count = 0;
     float total_length = 0.0f;
 
-    std::vector<vec3> points;
-    std::vector<vec3> controls;
-    std::vector<vec3> normals;
-    std::vector<float> lengths;
+    // error allowed when integrating a segment, relative to its length
+    float length_tolerance = 1e-4f;
+
+    // segments integrated per job when lengths are rebuilt in parallel
+    size_t parallel_grain = 256;
+
+    // the nodes, each with the coefficients, lengths, arc table, frames
+    // and bounds of the segment starting at it, in chunks that can be
+    // inserted into and shared cheaply
+    SplineNodes nodes;
+
+    // nodes whose segments were edited since the last Update, and nodes
+    // whose normals were edited but not their shape. kept by handle so
+    // inserts and deletes leave them pointing at the same nodes.
+    std::vector<NodeHandle> dirty_segments;
+    std::vector<NodeHandle> dirty_frames;
+
+    // every segment is rebuilt by the next Update
+    bool invalid = false;
+
+    size_t edit_depth = 0;
+
+    // incremented by every edit, lets derived data skip unchanged splines
+    uint64_t revision = 0;
+
+    // called after every edit
+    std::vector<SplineListener> listeners;
+
+    // called for every node an edit changes, before the edit is notified
+    std::vector<SplineNodeListener> node_listeners;
 
     void RecalculateControls(size_t i);
     void InsertPoint(vec3 position);
+    void InsertPointAfter(size_t index, vec3 position);
+    void DeletePoint(size_t index);
+
+    // adds a node on the curve at t, between index and the next node.
+    // the curve only passes through it, its shape either side changes
+    // slightly.
+    void InsertPointOnCurve(size_t index, float t);
+
     void MovePoint(size_t index, vec3 position);
     void MoveControl(size_t index, vec3 position);
     void MoveNormal(size_t index, vec3 position);
+
+    // store a node's values as given, with the control relative to the
+    // point and the normal left as it is
+    void SetPoint(size_t index, vec3 point);
+    void SetControl(size_t index, vec3 control);
+    void SetNormal(size_t index, vec3 normal);
+
+    // inserts a node at index, before the node there or at the end
+    void InsertPointBefore(size_t index, vec3 position);
+
+    void Apply(const SplineEdit& edit);
+    void AddListener(SplineListener listener);
+    void Notify(const SplineEdit& edit);
+    void AddNodeListener(SplineNodeListener listener);
+    void NotifyNode(const SplineNodeChange& change);
     size_t GetIndex(size_t i);
+
+    // index of a node, or count once it has been deleted
+    size_t Find(NodeHandle handle) const;
+    void BeginEdit();
+    void EndEdit();
+    void MarkDirty(size_t node);
+    void MarkFramesDirty(size_t node);
+    void Invalidate();
+
+    // node i and the segment starting at it, each found in O(log n).
+    // walks over many segments go through the chunks instead.
+    const SplineNode& Node(size_t i) const;
+    NodeHandle Handle(size_t i) const;
+    const SplineSegment& Segment(size_t i) const;
+    float Length(size_t i) const;
+    const float* ArcLengths(size_t i) const;
+    const quat* Frames(size_t i) const;
+
+    // control point hull of segment i
+    const Aabb& Bounds(size_t i) const;
+
+    // appends the segments inside the frustum in index order, as
+    // Bvh::Cull does
+    void Cull(
+        const Frustum& frustum,
+        float margin,
+        bool ground,
+        std::vector<size_t>& visible) const;
+
+    // node storage gains or loses one node, touching one chunk, and only
+    // the segments either side are marked for rebuilding
+    void InsertNode(size_t index, const SplineNode& node);
+    void EraseNode(size_t index);
+
+    // inserts a node by InsertPointAfter and InsertPointBefore, fitting
+    // the control of the new node only
+    void InsertFitted(size_t index, vec3 position, vec3 normal);
+
+    // writes node index and tells the node listeners
+    void StoreNode(size_t index, const SplineNode& node);
+
+    // replaces every node, with new handles. nothing derived from them is
+    // current until the bulk stages below have run.
+    void Assign(
+        const vec3* points,
+        const vec3* controls,
+        const vec3* normals,
+        size_t count);
+
+    // replaces the nodes with chunks kept from before, handles, segments
+    // and all, so nothing has to be rebuilt
+    void RestoreNodes(const std::vector<std::shared_ptr<const SplineNodes::Chunk>>& chunks);
+
     void Update();
+
+    // a full rebuild in stages: Prepare rebuilds the coefficients and
+    // bounds of every chunk, IntegrateChunk can then run concurrently on
+    // distinct chunks, as IntegrateAll does on the job system, and Finish
+    // sums the offsets and tells the node listeners every node changed
+    void Prepare();
+    void IntegrateChunk(size_t chunk);
+    void IntegrateAll();
+    void Finish();
+
+    // all three stages, for bulk changes such as loading
+    void Rebuild();
+
+    // rebuilds derived data around lengths and arc tables that were
+    // loaded rather than integrated, count and count * arc_samples of them
+    void Restore(const float* lengths, const float* arc_lengths);
+
     vec3 GetPoint(float f);
     vec3 GetGradient(float f);
     vec3 GetNormal(float f);
+    quat GetFrame(float f);
+    float GetCurvature(float f);
+    void Evaluate(const float* f, size_t n, const SplineSamples& out);
+    void EvaluateAtDistances(const float* d, size_t n, const SplineSamples& out);
+
+    // the same at t within segment i. a float holding both the index and
+    // t has steps of 1/16 at a million nodes, so long tracks go through
+    // these.
+    vec3 GetPoint(size_t i, float t) const;
+    vec3 GetGradient(size_t i, float t) const;
+    vec3 GetNormal(size_t i, float t) const;
+    quat GetFrame(size_t i, float t) const;
+
+    void Evaluate(
+        const uint32_t* segments,
+        const float* t,
+        size_t n,
+        const SplineSamples& out) const;
+
+    float CalculateArcLength(int node, float t0, float t1);
     float CalculateSegmentLength(int node);
     float GetNormalisedOffset(float p);
+
+    // segment holding a distance, and the parameter of it there
+    size_t FindParameter(double distance, float& t) const;
+    float GetSegmentOffset(size_t i, float d);
+    float GetDistance(float f);
+
+    // distance at the start of segment i, or the total length at count
+    double Offset(size_t i) const;
+
+    // segment holding a distance between zero and the total length
+    size_t FindSegment(double distance) const;
+
+private:
+    // segments being rebuilt by Update, the chunks they are in, and the
+    // dirty nodes found by handle
+    std::vector<SplineSegmentWork> work;
+    std::vector<size_t> work_chunks;
+    std::vector<size_t> shape_nodes;
+    std::vector<size_t> frame_nodes;
+
+    void UpdateChunk(size_t chunk, const float* lengths, const float* arc_lengths);
+    void FindDirty(const std::vector<NodeHandle>& handles, std::vector<size_t>& indices) const;
 };
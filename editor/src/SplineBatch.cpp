@@ -0,0 +1,335 @@
+#include "SplineBatch.hpp"
+
+#include "Simd.hpp"
+#include "Spline.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined (SIMD_SSE2)
+#include <emmintrin.h>
+#endif
+
+void spline_batch_scalar(
+    const SplineLanes& lanes,
+    size_t begin,
+    size_t end,
+    const SplineSamples& out,
+    size_t offset)
+{
+    for (size_t l = begin; l < end; l++)
+    {
+        float t = lanes.t[l];
+        size_t o = offset + l;
+        float g[3];
+
+        for (int a = 0; a < 3; a++)
+        {
+            float c0 = lanes.coefficients[0][a][l];
+            float c1 = lanes.coefficients[1][a][l];
+            float c2 = lanes.coefficients[2][a][l];
+            float c3 = lanes.coefficients[3][a][l];
+
+            if (out.position[0] != nullptr)
+            {
+                out.position[a][o] = c0 + t * (c1 + t * (c2 + t * c3));
+            }
+
+            g[a] = c1 + t * (2.0f * c2 + t * (3.0f * c3));
+
+            // a third of the derivative, as GetGradient returns
+            if (out.gradient[0] != nullptr)
+            {
+                out.gradient[a][o] = g[a] * (1.0f / 3.0f);
+            }
+        }
+
+        // y of the slerped frame, as GetNormal returns. dividing by the
+        // squared length keeps the rotation exact for a slightly
+        // unnormalised frame
+        if (out.normal[0] != nullptr)
+        {
+            float b = lanes.blend[l];
+            float c = 1.0f - b;
+            float angle = lanes.angle[l];
+            float w0 = c * FrameSlerp::Sinc(c * angle) * lanes.scale[l];
+            float w1 = b * FrameSlerp::Sinc(b * angle) * lanes.scale[l];
+            float q[4];
+
+            for (int a = 0; a < 4; a++)
+            {
+                q[a] = lanes.frames[0][a][l] * w0 + lanes.frames[1][a][l] * w1;
+            }
+
+            float x = q[0];
+            float y = q[1];
+            float z = q[2];
+            float w = q[3];
+            float d = 1.0f / (x * x + y * y + z * z + w * w);
+
+            out.normal[0][o] = 2.0f * (x * y - w * z) * d;
+            out.normal[1][o] = (w * w - x * x + y * y - z * z) * d;
+            out.normal[2][o] = 2.0f * (y * z + w * x) * d;
+        }
+    }
+}
+
+#if defined (SIMD_SSE2)
+// FrameSlerp::Sinc four lanes at a time
+static __m128 sse2_sinc(__m128 x)
+{
+    __m128 x2 = _mm_mul_ps(x, x);
+    __m128 s = _mm_set1_ps(-1.0f / 39916800.0f);
+
+    s = _mm_add_ps(_mm_set1_ps(1.0f / 362880.0f), _mm_mul_ps(x2, s));
+    s = _mm_add_ps(_mm_set1_ps(-1.0f / 5040.0f), _mm_mul_ps(x2, s));
+    s = _mm_add_ps(_mm_set1_ps(1.0f / 120.0f), _mm_mul_ps(x2, s));
+    s = _mm_add_ps(_mm_set1_ps(-1.0f / 6.0f), _mm_mul_ps(x2, s));
+
+    return _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(x2, s));
+}
+#endif
+
+void spline_batch_sse2(
+    const SplineLanes& lanes,
+    size_t begin,
+    size_t end,
+    const SplineSamples& out,
+    size_t offset)
+{
+    size_t l = begin;
+
+#if defined (SIMD_SSE2)
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 three = _mm_set1_ps(3.0f);
+    const __m128 third = _mm_set1_ps(1.0f / 3.0f);
+
+    for (; l + 4 <= end; l += 4)
+    {
+        __m128 t = _mm_loadu_ps(&lanes.t[l]);
+        size_t o = offset + l;
+        __m128 g[3];
+
+        for (int a = 0; a < 3; a++)
+        {
+            __m128 c0 = _mm_loadu_ps(&lanes.coefficients[0][a][l]);
+            __m128 c1 = _mm_loadu_ps(&lanes.coefficients[1][a][l]);
+            __m128 c2 = _mm_loadu_ps(&lanes.coefficients[2][a][l]);
+            __m128 c3 = _mm_loadu_ps(&lanes.coefficients[3][a][l]);
+
+            if (out.position[0] != nullptr)
+            {
+                __m128 p = _mm_add_ps(c2, _mm_mul_ps(t, c3));
+                p = _mm_add_ps(c1, _mm_mul_ps(t, p));
+                p = _mm_add_ps(c0, _mm_mul_ps(t, p));
+
+                _mm_storeu_ps(&out.position[a][o], p);
+            }
+
+            g[a] = _mm_add_ps(
+                _mm_mul_ps(two, c2),
+                _mm_mul_ps(t, _mm_mul_ps(three, c3)));
+            g[a] = _mm_add_ps(c1, _mm_mul_ps(t, g[a]));
+
+            if (out.gradient[0] != nullptr)
+            {
+                _mm_storeu_ps(&out.gradient[a][o], _mm_mul_ps(g[a], third));
+            }
+        }
+
+        if (out.normal[0] != nullptr)
+        {
+            __m128 b = _mm_loadu_ps(&lanes.blend[l]);
+            __m128 c = _mm_sub_ps(one, b);
+            __m128 angle = _mm_loadu_ps(&lanes.angle[l]);
+            __m128 scale = _mm_loadu_ps(&lanes.scale[l]);
+
+            __m128 w0 = _mm_mul_ps(_mm_mul_ps(c, sse2_sinc(_mm_mul_ps(c, angle))), scale);
+            __m128 w1 = _mm_mul_ps(_mm_mul_ps(b, sse2_sinc(_mm_mul_ps(b, angle))), scale);
+            __m128 q[4];
+
+            for (int a = 0; a < 4; a++)
+            {
+                q[a] = _mm_add_ps(
+                    _mm_mul_ps(_mm_loadu_ps(&lanes.frames[0][a][l]), w0),
+                    _mm_mul_ps(_mm_loadu_ps(&lanes.frames[1][a][l]), w1));
+            }
+
+            __m128 x = q[0];
+            __m128 y = q[1];
+            __m128 z = q[2];
+            __m128 w = q[3];
+
+            __m128 xx = _mm_mul_ps(x, x);
+            __m128 yy = _mm_mul_ps(y, y);
+            __m128 zz = _mm_mul_ps(z, z);
+            __m128 ww = _mm_mul_ps(w, w);
+
+            __m128 d = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(xx, yy), _mm_add_ps(zz, ww)));
+            __m128 d2 = _mm_mul_ps(two, d);
+
+            __m128 n0 = _mm_sub_ps(_mm_mul_ps(x, y), _mm_mul_ps(w, z));
+            __m128 n1 = _mm_sub_ps(_mm_add_ps(ww, yy), _mm_add_ps(xx, zz));
+            __m128 n2 = _mm_add_ps(_mm_mul_ps(y, z), _mm_mul_ps(w, x));
+
+            _mm_storeu_ps(&out.normal[0][o], _mm_mul_ps(n0, d2));
+            _mm_storeu_ps(&out.normal[1][o], _mm_mul_ps(n1, d));
+            _mm_storeu_ps(&out.normal[2][o], _mm_mul_ps(n2, d2));
+        }
+    }
+#endif
+
+    spline_batch_scalar(lanes, l, end, out, offset);
+}
+
+static SplineBatchKernel spline_batch_select()
+{
+    if (cpu_has_avx2() && spline_batch_avx2_kernel() != nullptr)
+    {
+        return spline_batch_avx2_kernel();
+    }
+
+    if (cpu_has_sse2())
+    {
+        return spline_batch_sse2;
+    }
+
+    return spline_batch_scalar;
+}
+
+SplineBatchKernel spline_batch_kernel()
+{
+    static const SplineBatchKernel kernel = spline_batch_select();
+    return kernel;
+}
+
+// gathers each sample's segment into lanes and runs the kernel over them.
+// locate(j, t) returns the segment of sample j and its parameter there
+template <typename Locate>
+static void spline_evaluate(
+    const Spline& spline,
+    size_t n,
+    const Locate& locate,
+    const SplineSamples& out)
+{
+    if (spline.count == 0)
+    {
+        return;
+    }
+
+    SplineBatchKernel kernel = spline_batch_kernel();
+    SplineLanes lanes;
+
+    bool normals = out.normal[0] != nullptr;
+    size_t cached = spline.count;
+    size_t cached_frame = SIZE_MAX;
+
+    // chunk holding the cached segment, and the index of its first node
+    const SplineNodes::Chunk* chunk = nullptr;
+    size_t first = 0;
+
+    const SplineSegment* segment = nullptr;
+    FrameSlerp slerp;
+
+    for (size_t base = 0; base < n; base += SplineLanes::size)
+    {
+        size_t m = n - base;
+        m = m < SplineLanes::size ? m : SplineLanes::size;
+
+        for (size_t l = 0; l < m; l++)
+        {
+            size_t i = locate(base + l, lanes.t[l]);
+
+            // consecutive samples usually share a segment, and nearly
+            // always a chunk
+            if (i != cached)
+            {
+                if (chunk == nullptr || i < first || i - first >= chunk->Size())
+                {
+                    chunk = spline.nodes.Chunks()[spline.nodes.Locate(i, first)].get();
+                }
+
+                segment = &chunk->segments[i - first];
+                cached = i;
+            }
+
+            if (normals)
+            {
+                float s = lanes.t[l] * Spline::frame_samples;
+                size_t k = std::min(static_cast<size_t>(s), Spline::frame_samples - 1);
+                size_t k0 = i * Spline::frame_samples + k;
+
+                if (k0 != cached_frame)
+                {
+                    const quat* frames = &chunk->frames[(i - first) * Spline::frame_samples];
+
+                    quat q1 = k + 1 < Spline::frame_samples ?
+                        frames[k + 1] : spline.Frames((i + 1) % spline.count)[0];
+
+                    slerp = FrameSlerp(frames[k], q1);
+                    cached_frame = k0;
+                }
+
+                for (int a = 0; a < 4; a++)
+                {
+                    lanes.frames[0][a][l] = slerp.q0[a];
+                    lanes.frames[1][a][l] = slerp.q1[a];
+                }
+
+                lanes.angle[l] = slerp.angle;
+                lanes.scale[l] = slerp.scale;
+                lanes.blend[l] = s - k;
+            }
+
+            for (int a = 0; a < 3; a++)
+            {
+                for (int k = 0; k < 4; k++)
+                {
+                    lanes.coefficients[k][a][l] = segment->c[k][a];
+                }
+            }
+        }
+
+        kernel(lanes, 0, m, out, base);
+    }
+}
+
+void Spline::Evaluate(
+    const float* f,
+    size_t n,
+    const SplineSamples& out)
+{
+    size_t segments = count;
+
+    spline_evaluate(*this, n, [f, segments](size_t j, float& t)
+    {
+        size_t i = static_cast<size_t>(f[j]);
+        t = f[j] - i;
+        return i % segments;
+    }, out);
+}
+
+void Spline::EvaluateAtDistances(
+    const float* d,
+    size_t n,
+    const SplineSamples& out)
+{
+    spline_evaluate(*this, n, [this, d](size_t j, float& t)
+    {
+        return FindParameter(d[j], t);
+    }, out);
+}
+
+void Spline::Evaluate(
+    const uint32_t* segments,
+    const float* t,
+    size_t n,
+    const SplineSamples& out) const
+{
+    spline_evaluate(*this, n, [segments, t](size_t j, float& u)
+    {
+        u = t[j];
+        return static_cast<size_t>(segments[j]);
+    }, out);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+// this header is included by translation units built with avx2 enabled,
+// so it must not pull in any inline code shared with the rest of the build
+
+#include <cstddef>
+
+// caller provided structure-of-arrays outputs for batch evaluation,
+// arrays left null are not written
+struct SplineSamples
+{
+    float* position[3] = { nullptr, nullptr, nullptr };
+    float* gradient[3] = { nullptr, nullptr, nullptr };
+    float* normal[3] = { nullptr, nullptr, nullptr };
+};
+
+// spline data gathered per sample, laid out for the evaluation kernels
+struct SplineLanes
+{
+    static const size_t size = 64;
+
+    alignas(32) float t[size];
+
+    // power basis coefficients of the sampled segment
+    alignas(32) float coefficients[4][3][size];
+
+    // the stored frames either side of the sample as x, y, z and w, and
+    // the angle and scale of the FrameSlerp between them
+    alignas(32) float frames[2][4][size];
+    alignas(32) float angle[size];
+    alignas(32) float scale[size];
+
+    // position of the sample between those frames
+    alignas(32) float blend[size];
+};
+
+// evaluates lanes [begin, end) into the outputs at offset + lane
+typedef void (*SplineBatchKernel)(
+    const SplineLanes& lanes,
+    size_t begin,
+    size_t end,
+    const SplineSamples& out,
+    size_t offset);
+
+void spline_batch_scalar(
+    const SplineLanes& lanes,
+    size_t begin,
+    size_t end,
+    const SplineSamples& out,
+    size_t offset);
+
+void spline_batch_sse2(
+    const SplineLanes& lanes,
+    size_t begin,
+    size_t end,
+    const SplineSamples& out,
+    size_t offset);
+
+// null when the avx2 kernel was not compiled in
+SplineBatchKernel spline_batch_avx2_kernel();
+
+// best kernel for the cpu we are running on
+SplineBatchKernel spline_batch_kernel();
@@ -0,0 +1,126 @@
+#include "SplineBatch.hpp"
+
+// built with avx2 and fma enabled, only called after a runtime cpu check
+
+#if defined (__AVX2__)
+
+#include <immintrin.h>
+
+// sin(x) / x as FrameSlerp::Sinc, eight lanes at a time
+static __m256 avx2_sinc(__m256 x)
+{
+    __m256 x2 = _mm256_mul_ps(x, x);
+    __m256 s = _mm256_set1_ps(-1.0f / 39916800.0f);
+
+    s = _mm256_fmadd_ps(x2, s, _mm256_set1_ps(1.0f / 362880.0f));
+    s = _mm256_fmadd_ps(x2, s, _mm256_set1_ps(-1.0f / 5040.0f));
+    s = _mm256_fmadd_ps(x2, s, _mm256_set1_ps(1.0f / 120.0f));
+    s = _mm256_fmadd_ps(x2, s, _mm256_set1_ps(-1.0f / 6.0f));
+
+    return _mm256_fmadd_ps(x2, s, _mm256_set1_ps(1.0f));
+}
+
+static void spline_batch_avx2(
+    const SplineLanes& lanes,
+    size_t begin,
+    size_t end,
+    const SplineSamples& out,
+    size_t offset)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 three = _mm256_set1_ps(3.0f);
+    const __m256 third = _mm256_set1_ps(1.0f / 3.0f);
+
+    size_t l = begin;
+
+    for (; l + 8 <= end; l += 8)
+    {
+        __m256 t = _mm256_loadu_ps(&lanes.t[l]);
+        size_t o = offset + l;
+        __m256 g[3];
+
+        for (int a = 0; a < 3; a++)
+        {
+            __m256 c0 = _mm256_loadu_ps(&lanes.coefficients[0][a][l]);
+            __m256 c1 = _mm256_loadu_ps(&lanes.coefficients[1][a][l]);
+            __m256 c2 = _mm256_loadu_ps(&lanes.coefficients[2][a][l]);
+            __m256 c3 = _mm256_loadu_ps(&lanes.coefficients[3][a][l]);
+
+            if (out.position[0] != nullptr)
+            {
+                __m256 p = _mm256_fmadd_ps(t, c3, c2);
+                p = _mm256_fmadd_ps(t, p, c1);
+                p = _mm256_fmadd_ps(t, p, c0);
+
+                _mm256_storeu_ps(&out.position[a][o], p);
+            }
+
+            g[a] = _mm256_fmadd_ps(t, _mm256_mul_ps(three, c3), _mm256_mul_ps(two, c2));
+            g[a] = _mm256_fmadd_ps(t, g[a], c1);
+
+            if (out.gradient[0] != nullptr)
+            {
+                _mm256_storeu_ps(&out.gradient[a][o], _mm256_mul_ps(g[a], third));
+            }
+        }
+
+        if (out.normal[0] != nullptr)
+        {
+            __m256 b = _mm256_loadu_ps(&lanes.blend[l]);
+            __m256 c = _mm256_sub_ps(one, b);
+            __m256 angle = _mm256_loadu_ps(&lanes.angle[l]);
+            __m256 scale = _mm256_loadu_ps(&lanes.scale[l]);
+
+            __m256 w0 = _mm256_mul_ps(_mm256_mul_ps(c, avx2_sinc(_mm256_mul_ps(c, angle))), scale);
+            __m256 w1 = _mm256_mul_ps(_mm256_mul_ps(b, avx2_sinc(_mm256_mul_ps(b, angle))), scale);
+            __m256 q[4];
+
+            for (int a = 0; a < 4; a++)
+            {
+                q[a] = _mm256_fmadd_ps(
+                    _mm256_loadu_ps(&lanes.frames[1][a][l]), w1,
+                    _mm256_mul_ps(_mm256_loadu_ps(&lanes.frames[0][a][l]), w0));
+            }
+
+            __m256 x = q[0];
+            __m256 y = q[1];
+            __m256 z = q[2];
+            __m256 w = q[3];
+
+            __m256 s = _mm256_mul_ps(x, x);
+            s = _mm256_fmadd_ps(y, y, s);
+            s = _mm256_fmadd_ps(z, z, s);
+            s = _mm256_fmadd_ps(w, w, s);
+
+            __m256 d = _mm256_div_ps(one, s);
+            __m256 d2 = _mm256_mul_ps(two, d);
+
+            __m256 n0 = _mm256_fmsub_ps(x, y, _mm256_mul_ps(w, z));
+            __m256 n1 = _mm256_sub_ps(
+                _mm256_fmadd_ps(w, w, _mm256_mul_ps(y, y)),
+                _mm256_fmadd_ps(x, x, _mm256_mul_ps(z, z)));
+            __m256 n2 = _mm256_fmadd_ps(y, z, _mm256_mul_ps(w, x));
+
+            _mm256_storeu_ps(&out.normal[0][o], _mm256_mul_ps(n0, d2));
+            _mm256_storeu_ps(&out.normal[1][o], _mm256_mul_ps(n1, d));
+            _mm256_storeu_ps(&out.normal[2][o], _mm256_mul_ps(n2, d2));
+        }
+    }
+
+    spline_batch_sse2(lanes, l, end, out, offset);
+}
+
+SplineBatchKernel spline_batch_avx2_kernel()
+{
+    return spline_batch_avx2;
+}
+
+#else
+
+SplineBatchKernel spline_batch_avx2_kernel()
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,175 @@
+#include "SplineCursor.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+SplineCursor::SplineCursor(const Spline& spline) :
+    spline(spline)
+{
+    Seek(0.0);
+}
+
+void SplineCursor::Seek(double d)
+{
+    segment = 0;
+    arc = 0;
+    distance = 0.0;
+    t = 0.0f;
+    frame = SIZE_MAX;
+
+    if (spline.count == 0)
+    {
+        return;
+    }
+
+    double total = spline.Offset(spline.count);
+    distance = total > 0.0 ? d - floor(d / total) * total : 0.0;
+    segment = spline.FindSegment(distance);
+
+    Enter(spline.nodes.Locate(segment, first));
+    Locate();
+}
+
+SplineCursorSample SplineCursor::Advance(float d)
+{
+    if (spline.count == 0)
+    {
+        return Sample();
+    }
+
+    double total = spline.Offset(spline.count);
+
+    // going back or a lap or more is cheaper to search for
+    if (d < 0.0f || d >= total)
+    {
+        Seek(distance + d);
+        return Sample();
+    }
+
+    distance += d;
+
+    if (distance >= total)
+    {
+        distance -= total;
+        segment = 0;
+        arc = 0;
+        first = 0;
+        Enter(0);
+    }
+
+    // the next segment starts where the spline's own offsets say, so a
+    // walk and a search agree on which segment holds every distance
+    while (segment + 1 < spline.count)
+    {
+        const SplineNodes::Chunk& c = *spline.nodes.Chunks()[chunk];
+        size_t slot = segment - first;
+        bool last = slot + 1 >= c.Size();
+
+        if ((last ? end : start + c.offsets[slot + 1]) > distance)
+        {
+            break;
+        }
+
+        segment++;
+        arc = 0;
+
+        if (last)
+        {
+            first = segment;
+            Enter(chunk + 1);
+        }
+    }
+
+    Locate();
+
+    return Sample();
+}
+
+void SplineCursor::Enter(size_t c)
+{
+    chunk = c;
+    start = spline.nodes.Start(c);
+    end = c + 1 < spline.nodes.Chunks().size() ?
+        spline.nodes.Start(c + 1) : spline.Offset(spline.count);
+}
+
+// finds the arc sample holding the distance, from the one last used
+void SplineCursor::Locate()
+{
+    const SplineNodes::Chunk& c = *spline.nodes.Chunks()[chunk];
+    size_t slot = segment - first;
+
+    const float* table = &c.arc_lengths[slot * Spline::arc_samples];
+    float d = static_cast<float>(distance - (start + c.offsets[slot]));
+
+    while (arc + 1 < Spline::arc_samples && table[arc] < d)
+    {
+        arc++;
+    }
+
+    float d0 = arc > 0 ? table[arc - 1] : 0.0f;
+    float d1 = table[arc];
+    float s = d1 > d0 ? (d - d0) / (d1 - d0) : 0.0f;
+    s = glm::clamp(s, 0.0f, 1.0f);
+
+    t = (arc + s) / Spline::arc_samples;
+
+    float f = t * Spline::frame_samples;
+    size_t k = std::min(static_cast<size_t>(f), Spline::frame_samples - 1);
+    size_t k0 = segment * Spline::frame_samples + k;
+
+    // many steps fall between the same pair of frames
+    if (k0 != frame)
+    {
+        const quat* frames = &c.frames[slot * Spline::frame_samples];
+
+        // the last frame of a segment leads into the first of the next
+        quat q1 = k + 1 < Spline::frame_samples ?
+            frames[k + 1] : spline.Frames((segment + 1) % spline.count)[0];
+
+        frame = k0;
+        slerp = FrameSlerp(frames[k], q1);
+    }
+
+    blend = f - k;
+}
+
+SplineCursorSample SplineCursor::Sample() const
+{
+    SplineCursorSample sample;
+
+    if (spline.count == 0)
+    {
+        sample.position = vec3();
+        sample.tangent = vec3(0, 0, 1);
+        sample.frame = quat();
+
+        return sample;
+    }
+
+    const SplineSegment& s = spline.nodes.Chunks()[chunk]->segments[segment - first];
+    vec3 d = s.Derivative(t);
+    float speed = glm::length(d);
+
+    // the stored frames slerped to t, as GetFrame does
+    sample.position = s.Point(t);
+    sample.frame = slerp.At(blend);
+    sample.tangent = speed > 0.0f ? d / speed : sample.frame * vec3(0, 0, 1);
+
+    return sample;
+}
+
+double SplineCursor::Distance() const
+{
+    return distance;
+}
+
+size_t SplineCursor::Segment() const
+{
+    return segment;
+}
+
+float SplineCursor::Parameter() const
+{
+    return t;
+}
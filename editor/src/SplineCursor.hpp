@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Math.hpp"
+#include "Spline.hpp"
+
+// everything a walk along the track needs at one place
+struct SplineCursorSample
+{
+    vec3 position;
+    vec3 tangent;
+
+    // takes x, y and z to the binormal, normal and tangent
+    quat frame;
+};
+
+// walks a spline forward at constant speed, keeping its segment and arc
+// sample between steps so a whole traversal costs one pass over the
+// tables rather than a search per sample. the spline must not be edited
+// while a cursor is in use.
+class SplineCursor
+{
+public:
+    explicit SplineCursor(const Spline& spline);
+
+    // jumps to a distance from the start, searching the offsets
+    void Seek(double distance);
+
+    // moves forward, wrapping past the end of the closed track, and
+    // returns the sample at the new place. the cost is in the segments
+    // passed, so long jumps and moving back go through Seek.
+    SplineCursorSample Advance(float distance);
+
+    SplineCursorSample Sample() const;
+
+    double Distance() const;
+    size_t Segment() const;
+    float Parameter() const;
+
+private:
+    const Spline& spline;
+
+    size_t segment = 0;
+    size_t arc = 0;
+    double distance = 0.0;
+    float t = 0.0f;
+
+    // chunk holding the segment, the index of its first node, and the
+    // distances at its start and at the start of the next chunk
+    size_t chunk = 0;
+    size_t first = 0;
+    double start = 0.0;
+    double end = 0.0;
+
+    // the stored frames either side, and where t lies between
+    size_t frame = 0;
+    FrameSlerp slerp;
+    float blend = 0.0f;
+
+    void Enter(size_t chunk);
+
+    void Locate();
+};
@@ -0,0 +1,670 @@
+#include "SplineNodes.hpp"
+
+#include <algorithm>
+
+// every per node array gains an entry at slot, left for the owner to fill
+static void insert_slot(
+    SplineNodes::Chunk& chunk,
+    size_t slot,
+    const SplineNode& node,
+    NodeHandle handle)
+{
+    const size_t arcs = SplineNodes::arc_samples;
+    const size_t frames = SplineNodes::frame_samples;
+
+    // the new segment has no length yet, so the offsets still hold
+    double offset = slot < chunk.offsets.size() ? chunk.offsets[slot] : chunk.length;
+
+    chunk.nodes.insert(chunk.nodes.begin() + slot, node);
+    chunk.handles.insert(chunk.handles.begin() + slot, handle);
+    chunk.segments.insert(chunk.segments.begin() + slot, SplineSegment());
+    chunk.lengths.insert(chunk.lengths.begin() + slot, 0.0f);
+    chunk.arc_lengths.insert(chunk.arc_lengths.begin() + slot * arcs, arcs, 0.0f);
+    chunk.frames.insert(chunk.frames.begin() + slot * frames, frames, quat());
+    chunk.offsets.insert(chunk.offsets.begin() + slot, offset);
+    chunk.bounds.Insert(slot, Aabb());
+    chunk.node_bounds.Insert(slot, Aabb());
+}
+
+static void erase_slot(
+    SplineNodes::Chunk& chunk,
+    size_t slot)
+{
+    const size_t arcs = SplineNodes::arc_samples;
+    const size_t frames = SplineNodes::frame_samples;
+
+    chunk.nodes.erase(chunk.nodes.begin() + slot);
+    chunk.handles.erase(chunk.handles.begin() + slot);
+    chunk.segments.erase(chunk.segments.begin() + slot);
+    chunk.lengths.erase(chunk.lengths.begin() + slot);
+    chunk.arc_lengths.erase(
+        chunk.arc_lengths.begin() + slot * arcs,
+        chunk.arc_lengths.begin() + (slot + 1) * arcs);
+    chunk.frames.erase(
+        chunk.frames.begin() + slot * frames,
+        chunk.frames.begin() + (slot + 1) * frames);
+    chunk.offsets.erase(chunk.offsets.begin() + slot);
+    chunk.bounds.Erase(slot);
+    chunk.node_bounds.Erase(slot);
+}
+
+// copies the slots of one chunk from first on to the end of another
+static void append_slots(
+    const SplineNodes::Chunk& from,
+    size_t first,
+    SplineNodes::Chunk& to)
+{
+    const size_t arcs = SplineNodes::arc_samples;
+    const size_t frames = SplineNodes::frame_samples;
+
+    size_t begin = to.Size();
+    size_t n = from.Size() - first;
+
+    to.nodes.insert(to.nodes.end(), from.nodes.begin() + first, from.nodes.end());
+    to.handles.insert(to.handles.end(), from.handles.begin() + first, from.handles.end());
+    to.segments.insert(to.segments.end(), from.segments.begin() + first, from.segments.end());
+    to.lengths.insert(to.lengths.end(), from.lengths.begin() + first, from.lengths.end());
+    to.arc_lengths.insert(to.arc_lengths.end(), from.arc_lengths.begin() + first * arcs, from.arc_lengths.end());
+    to.frames.insert(to.frames.end(), from.frames.begin() + first * frames, from.frames.end());
+    to.offsets.resize(begin + n);
+
+    to.bounds.Resize(begin + n);
+    to.node_bounds.Resize(begin + n);
+
+    for (size_t k = 0; k < n; k++)
+    {
+        to.bounds.SetLeaf(begin + k, from.bounds.GetLeaf(first + k));
+        to.node_bounds.SetLeaf(begin + k, from.node_bounds.GetLeaf(first + k));
+    }
+}
+
+static void truncate_slots(
+    SplineNodes::Chunk& chunk,
+    size_t size)
+{
+    chunk.nodes.resize(size);
+    chunk.handles.resize(size);
+    chunk.segments.resize(size);
+    chunk.lengths.resize(size);
+    chunk.arc_lengths.resize(size * SplineNodes::arc_samples);
+    chunk.frames.resize(size * SplineNodes::frame_samples);
+    chunk.offsets.resize(size);
+    chunk.bounds.Resize(size);
+    chunk.node_bounds.Resize(size);
+}
+
+// sums the segment lengths from the start of the chunk and refits its
+// boxes, always in the same order so a chunk sums the same however its
+// segments were rebuilt
+static void refit_chunk(SplineNodes::Chunk& chunk)
+{
+    double sum = 0.0;
+
+    chunk.offsets.resize(chunk.lengths.size());
+
+    for (size_t i = 0; i < chunk.lengths.size(); i++)
+    {
+        chunk.offsets[i] = sum;
+        sum += chunk.lengths[i];
+    }
+
+    chunk.length = sum;
+    chunk.bounds.Refit();
+    chunk.node_bounds.Refit();
+}
+
+// a box grown as Bvh::Cull grows its own
+static Aabb cull_box(
+    Aabb box,
+    float margin,
+    bool ground)
+{
+    box.min -= vec3(margin);
+    box.max += vec3(margin);
+
+    if (ground)
+    {
+        box.min.y = glm::min(box.min.y, 0.0f);
+        box.max.y = glm::max(box.max.y, 0.0f);
+    }
+
+    return box;
+}
+
+size_t SplineNodes::Chunk::Size() const
+{
+    return nodes.size();
+}
+
+size_t SplineNodes::Chunk::Bytes() const
+{
+    // a box tree holds up to two boxes per leaf
+    return
+        sizeof(Chunk) +
+        nodes.capacity() * sizeof(SplineNode) +
+        handles.capacity() * sizeof(NodeHandle) +
+        segments.capacity() * sizeof(SplineSegment) +
+        lengths.capacity() * sizeof(float) +
+        arc_lengths.capacity() * sizeof(float) +
+        frames.capacity() * sizeof(quat) +
+        offsets.capacity() * sizeof(double) +
+        (bounds.Size() + node_bounds.Size()) * 2 * sizeof(Aabb);
+}
+
+size_t SplineNodes::Size() const
+{
+    return tree.empty() ? 0 : tree[1].count;
+}
+
+const SplineNode& SplineNodes::Get(size_t index) const
+{
+    size_t first = 0;
+    size_t c = Locate(index, first);
+
+    return chunks[c]->nodes[index - first];
+}
+
+NodeHandle SplineNodes::Handle(size_t index) const
+{
+    size_t first = 0;
+    size_t c = Locate(index, first);
+
+    return chunks[c]->handles[index - first];
+}
+
+size_t SplineNodes::Find(NodeHandle handle) const
+{
+    if (!Contains(handle))
+    {
+        return Size();
+    }
+
+    const Location& location = locations[handle];
+
+    return First(chunk_positions[location.chunk]) + location.slot;
+}
+
+bool SplineNodes::Contains(NodeHandle handle) const
+{
+    return handle < locations.size() && locations[handle].chunk != UINT32_MAX;
+}
+
+NodeHandle SplineNodes::Insert(size_t index, const SplineNode& node)
+{
+    if (chunks.empty())
+    {
+        InsertChunk(0, std::make_shared<Chunk>());
+    }
+
+    size_t size = Size();
+    size_t first = 0;
+    size_t c = 0;
+
+    if (index < size)
+    {
+        c = Locate(index, first);
+    }
+    else
+    {
+        c = chunks.size() - 1;
+        first = size - chunks[c]->Size();
+    }
+
+    // a full chunk hands its second half to a new one after it
+    if (chunks[c]->Size() >= chunk_size)
+    {
+        const Chunk& full = *chunks[c];
+        size_t half = full.Size() / 2;
+
+        auto second = std::make_shared<Chunk>();
+        append_slots(full, half, *second);
+        refit_chunk(*second);
+
+        Chunk& kept = Write(c);
+        truncate_slots(kept, half);
+        refit_chunk(kept);
+
+        InsertChunk(c + 1, second);
+        SetLocations(c + 1, 0);
+
+        if (index - first > half)
+        {
+            first += half;
+            c++;
+        }
+    }
+
+    NodeHandle handle = next_handle++;
+    size_t slot = index - first;
+
+    insert_slot(Write(c), slot, node, handle);
+
+    locations.resize(next_handle);
+    SetLocations(c, slot);
+    Summarise(c);
+
+    return handle;
+}
+
+void SplineNodes::Set(size_t index, const SplineNode& node)
+{
+    size_t first = 0;
+    size_t c = Locate(index, first);
+
+    Write(c).nodes[index - first] = node;
+}
+
+void SplineNodes::Erase(size_t index)
+{
+    size_t first = 0;
+    size_t c = Locate(index, first);
+    size_t slot = index - first;
+
+    Chunk& chunk = Write(c);
+    locations[chunk.handles[slot]] = Location();
+    erase_slot(chunk, slot);
+
+    SetLocations(c, slot);
+
+    if (chunk.nodes.empty())
+    {
+        EraseChunk(c);
+        return;
+    }
+
+    // a small chunk takes in the next one when both fit in half a chunk,
+    // so chunks stay at least a quarter full on average
+    if (c + 1 < chunks.size() &&
+        chunk.Size() + chunks[c + 1]->Size() <= chunk_size / 2)
+    {
+        size_t from = chunk.Size();
+
+        append_slots(*chunks[c + 1], 0, chunk);
+        refit_chunk(chunk);
+
+        EraseChunk(c + 1);
+        SetLocations(c, from);
+        return;
+    }
+
+    Summarise(c);
+}
+
+void SplineNodes::Assign(
+    const vec3* points,
+    const vec3* controls,
+    const vec3* normals,
+    size_t count)
+{
+    chunks.clear();
+    locations.assign(count, Location());
+    next_handle = static_cast<NodeHandle>(count);
+
+    // half full, so inserts do not split every chunk straight away
+    for (size_t first = 0; first < count; first += chunk_size / 2)
+    {
+        size_t last = std::min(first + chunk_size / 2, count);
+
+        auto chunk = std::make_shared<Chunk>();
+        truncate_slots(*chunk, last - first);
+
+        for (size_t i = first; i < last; i++)
+        {
+            SplineNode& node = chunk->nodes[i - first];
+            node.point = points[i];
+            node.control = controls[i];
+            node.normal = normals[i];
+            chunk->handles[i - first] = static_cast<NodeHandle>(i);
+        }
+
+        chunks.push_back(chunk);
+    }
+
+    chunk_ids.clear();
+    chunk_positions.clear();
+    free_chunk_ids.clear();
+
+    for (size_t c = 0; c < chunks.size(); c++)
+    {
+        chunk_ids.push_back(static_cast<uint32_t>(c));
+        SetLocations(c, 0);
+    }
+
+    Rebuild();
+}
+
+const std::vector<std::shared_ptr<const SplineNodes::Chunk>>& SplineNodes::Chunks() const
+{
+    return chunks;
+}
+
+void SplineNodes::Restore(const std::vector<std::shared_ptr<const Chunk>>& restored)
+{
+    chunks = restored;
+    chunk_ids.clear();
+    chunk_positions.clear();
+    free_chunk_ids.clear();
+
+    std::fill(locations.begin(), locations.end(), Location());
+
+    for (size_t c = 0; c < chunks.size(); c++)
+    {
+        for (NodeHandle handle : chunks[c]->handles)
+        {
+            next_handle = std::max(next_handle, handle + 1);
+        }
+
+        locations.resize(next_handle);
+        chunk_ids.push_back(static_cast<uint32_t>(c));
+        SetLocations(c, 0);
+    }
+
+    Rebuild();
+}
+
+size_t SplineNodes::Locate(size_t index, size_t& first) const
+{
+    size_t node = 1;
+    first = 0;
+
+    while (node < leaf_base)
+    {
+        const Summary& left = tree[node * 2];
+
+        if (index - first < left.count)
+        {
+            node = node * 2;
+        }
+        else
+        {
+            first += left.count;
+            node = node * 2 + 1;
+        }
+    }
+
+    return node - leaf_base;
+}
+
+size_t SplineNodes::LocateDistance(double distance, size_t& first, double& start) const
+{
+    size_t node = 1;
+    first = 0;
+    start = 0.0;
+
+    while (node < leaf_base)
+    {
+        const Summary& left = tree[node * 2];
+
+        if (tree[node * 2 + 1].count > 0 && distance >= start + left.length)
+        {
+            first += left.count;
+            start += left.length;
+            node = node * 2 + 1;
+        }
+        else
+        {
+            node = node * 2;
+        }
+    }
+
+    return node - leaf_base;
+}
+
+size_t SplineNodes::First(size_t chunk) const
+{
+    size_t first = 0;
+    double start = 0.0;
+    Prefix(chunk, first, start);
+
+    return first;
+}
+
+double SplineNodes::Start(size_t chunk) const
+{
+    size_t first = 0;
+    double start = 0.0;
+    Prefix(chunk, first, start);
+
+    return start;
+}
+
+double SplineNodes::Length() const
+{
+    return tree.empty() ? 0.0 : tree[1].length;
+}
+
+SplineNodes::Chunk& SplineNodes::Write(size_t chunk)
+{
+    // copies made by Chunks() keep their own version
+    if (chunks[chunk].use_count() > 1)
+    {
+        chunks[chunk] = std::make_shared<Chunk>(*chunks[chunk]);
+        copied_bytes += chunks[chunk]->Bytes();
+    }
+
+    // every chunk is made non-const, only shared as const
+    return const_cast<Chunk&>(*chunks[chunk]);
+}
+
+void SplineNodes::Refresh(size_t chunk)
+{
+    refit_chunk(Write(chunk));
+    Summarise(chunk);
+}
+
+void SplineNodes::RefreshAll()
+{
+    for (size_t c = 0; c < chunks.size(); c++)
+    {
+        refit_chunk(Write(c));
+    }
+
+    Rebuild();
+}
+
+void SplineNodes::Cull(
+    const Frustum& frustum,
+    float margin,
+    bool ground,
+    std::vector<size_t>& visible) const
+{
+    if (chunks.empty())
+    {
+        return;
+    }
+
+    // node, and the index of the first segment below it
+    size_t stack[64][2];
+    size_t top = 0;
+
+    stack[top][0] = 1;
+    stack[top][1] = 0;
+    top++;
+
+    while (top > 0)
+    {
+        top--;
+        size_t node = stack[top][0];
+        size_t first = stack[top][1];
+
+        const Summary& summary = tree[node];
+
+        if (summary.count == 0 || summary.bounds.Empty())
+        {
+            continue;
+        }
+
+        FrustumTest test = frustum.Test(cull_box(summary.bounds, margin, ground));
+
+        if (test == FrustumTest::OUTSIDE)
+        {
+            continue;
+        }
+
+        if (test == FrustumTest::INSIDE)
+        {
+            // every segment of every chunk below is visible
+            for (size_t i = first; i < first + summary.count; i++)
+            {
+                visible.push_back(i);
+            }
+
+            continue;
+        }
+
+        if (node >= leaf_base)
+        {
+            size_t from = visible.size();
+            chunks[node - leaf_base]->bounds.Cull(frustum, margin, ground, visible);
+
+            for (size_t k = from; k < visible.size(); k++)
+            {
+                visible[k] += first;
+            }
+
+            continue;
+        }
+
+        // right first so segments come out in index order
+        stack[top][0] = node * 2 + 1;
+        stack[top][1] = first + tree[node * 2].count;
+        top++;
+
+        stack[top][0] = node * 2;
+        stack[top][1] = first;
+        top++;
+    }
+}
+
+size_t SplineNodes::CopiedBytes() const
+{
+    return copied_bytes;
+}
+
+void SplineNodes::SetLocations(size_t chunk, size_t from)
+{
+    const std::vector<NodeHandle>& handles = chunks[chunk]->handles;
+    uint32_t id = chunk_ids[chunk];
+
+    for (size_t slot = from; slot < handles.size(); slot++)
+    {
+        Location& location = locations[handles[slot]];
+        location.chunk = id;
+        location.slot = static_cast<uint32_t>(slot);
+    }
+}
+
+void SplineNodes::InsertChunk(size_t position, std::shared_ptr<const Chunk> chunk)
+{
+    uint32_t id = static_cast<uint32_t>(chunk_ids.size() + free_chunk_ids.size());
+
+    if (!free_chunk_ids.empty())
+    {
+        id = free_chunk_ids.back();
+        free_chunk_ids.pop_back();
+    }
+
+    chunks.insert(chunks.begin() + position, std::move(chunk));
+    chunk_ids.insert(chunk_ids.begin() + position, id);
+
+    Rebuild();
+}
+
+void SplineNodes::EraseChunk(size_t position)
+{
+    free_chunk_ids.push_back(chunk_ids[position]);
+
+    chunks.erase(chunks.begin() + position);
+    chunk_ids.erase(chunk_ids.begin() + position);
+
+    Rebuild();
+}
+
+void SplineNodes::Summarise(size_t chunk)
+{
+    SetLeaf(chunk);
+
+    for (size_t node = (leaf_base + chunk) / 2; node >= 1; node /= 2)
+    {
+        Join(node);
+    }
+}
+
+void SplineNodes::SetLeaf(size_t chunk)
+{
+    const Chunk& source = *chunks[chunk];
+    Summary& leaf = tree[leaf_base + chunk];
+
+    leaf.count = source.Size();
+    leaf.length = source.length;
+    leaf.bounds = source.bounds.Bounds();
+    leaf.node_bounds = source.node_bounds.Bounds();
+}
+
+void SplineNodes::Join(size_t node)
+{
+    const Summary& left = tree[node * 2];
+    const Summary& right = tree[node * 2 + 1];
+    Summary& parent = tree[node];
+
+    parent.count = left.count + right.count;
+    parent.length = left.length + right.length;
+    parent.bounds = left.bounds;
+    parent.bounds.Extend(right.bounds);
+    parent.node_bounds = left.node_bounds;
+    parent.node_bounds.Extend(right.node_bounds);
+}
+
+// only when chunks are added or removed, once per many edits
+void SplineNodes::Rebuild()
+{
+    size_t n = chunks.size();
+
+    chunk_positions.resize(chunk_ids.size() + free_chunk_ids.size());
+
+    for (size_t c = 0; c < n; c++)
+    {
+        chunk_positions[chunk_ids[c]] = static_cast<uint32_t>(c);
+    }
+
+    leaf_base = 1;
+    leaf_depth = 0;
+
+    while (leaf_base < n)
+    {
+        leaf_base *= 2;
+        leaf_depth++;
+    }
+
+    tree.assign(leaf_base * 2, Summary());
+
+    for (size_t c = 0; c < n; c++)
+    {
+        SetLeaf(c);
+    }
+
+    for (size_t node = leaf_base - 1; node >= 1; node--)
+    {
+        Join(node);
+    }
+}
+
+void SplineNodes::Prefix(size_t chunk, size_t& first, double& start) const
+{
+    size_t leaf = leaf_base + chunk;
+
+    first = 0;
+    start = 0.0;
+
+    // from the root down, adding every left sibling passed on the way
+    for (size_t level = leaf_depth; level > 0; level--)
+    {
+        size_t node = leaf >> (level - 1);
+
+        if (node & 1)
+        {
+            first += tree[node - 1].count;
+            start += tree[node - 1].length;
+        }
+    }
+}
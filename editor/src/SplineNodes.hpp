@@ -0,0 +1,311 @@
+#pragma once
+
+#include "Math.hpp"
+#include "Culling.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// names a node for as long as it exists, whatever is inserted or deleted
+// around it
+using NodeHandle = uint32_t;
+
+static const NodeHandle invalid_node = UINT32_MAX;
+
+struct SplineNode
+{
+    vec3 point;
+    vec3 control;
+    vec3 normal = vec3(0, 1, 0);
+};
+
+// power basis coefficients of one segment, p(t) = c0 + t (c1 + t (c2 + t c3)),
+// sized and aligned to fill a single cache line
+struct alignas(16) SplineSegment
+{
+    aligned_vec4 c[4];
+
+    vec3 Point(float t) const
+    {
+        return vec3(c[0] + t * (c[1] + t * (c[2] + t * c[3])));
+    }
+
+    vec3 Derivative(float t) const
+    {
+        return vec3(c[1] + t * (2.0f * c[2] + t * (3.0f * c[3])));
+    }
+
+    vec3 SecondDerivative(float t) const
+    {
+        return vec3(2.0f * c[2] + t * (6.0f * c[3]));
+    }
+};
+
+// slerps between two neighbouring frames as glm::slerp does, finding the
+// angle between them once for the many samples that fall in between.
+// the batch kernels repeat At lane by lane.
+struct FrameSlerp
+{
+    quat q0;
+    quat q1;
+    float angle = 0.0f;
+    float scale = 1.0f;
+
+    FrameSlerp() = default;
+
+    FrameSlerp(quat a, quat b) :
+        q0(a),
+        q1(b)
+    {
+        float c = glm::dot(a, b);
+
+        // the shorter way round
+        if (c < 0.0f)
+        {
+            q1 = -b;
+            c = -c;
+        }
+
+        angle = acosf(glm::min(c, 1.0f));
+        scale = 1.0f / Sinc(angle);
+    }
+
+    // weights sin((1 - s) angle) / sin(angle) and sin(s angle) / sin(angle),
+    // written so equal frames need no special case
+    quat At(float s) const
+    {
+        float w0 = (1.0f - s) * Sinc((1.0f - s) * angle) * scale;
+        float w1 = s * Sinc(s * angle) * scale;
+
+        return q0 * w0 + q1 * w1;
+    }
+
+    // sin(x) / x for x within [0, pi / 2], which the angle between two
+    // unit quaternions on the same side always is, good to 1e-7 there
+    static float Sinc(float x)
+    {
+        float x2 = x * x;
+
+        return 1.0f + x2 * (-1.0f / 6.0f + x2 * (1.0f / 120.0f + x2 * (-1.0f / 5040.0f +
+            x2 * (1.0f / 362880.0f - x2 * (1.0f / 39916800.0f)))));
+    }
+};
+
+// nodes in order, split into chunks of at most chunk_size nodes. each
+// chunk also holds the segment starting at each of its nodes and what is
+// derived from it, so an edit only writes the chunks around it. a tree
+// over the chunks sums their sizes, lengths and boxes, finding a node, a
+// distance or the chunks in view in O(log n) plus one chunk, and is only
+// rebuilt when chunks are added or removed. chunks are shared between
+// copies and only copied when written to, so copying the storage copies
+// the handle table and the tree but no chunks.
+class SplineNodes
+{
+public:
+    static const size_t chunk_size = 512;
+
+    // arc-length samples and frames stored per segment
+    static const size_t arc_samples = 16;
+    static const size_t frame_samples = 4;
+
+    struct Chunk
+    {
+        std::vector<SplineNode> nodes;
+        std::vector<NodeHandle> handles;
+
+        std::vector<SplineSegment> segments;
+        std::vector<float> lengths;
+
+        // distance from the start of each segment at t = (k + 1) / arc_samples
+        std::vector<float> arc_lengths;
+
+        // rotation minimising frames at t = k / frame_samples of each
+        // segment, taking x, y and z to the binormal, normal and tangent
+        std::vector<quat> frames;
+
+        // distance from the start of the chunk to the start of each
+        // segment, and the summed length of them all
+        std::vector<double> offsets;
+        double length = 0.0;
+
+        // control point hull of each segment, and a box around each
+        // node's point and the ends of its control and normal
+        Bvh bounds;
+        Bvh node_bounds;
+
+        size_t Size() const;
+        size_t Bytes() const;
+    };
+
+    size_t Size() const;
+
+    const SplineNode& Get(size_t index) const;
+    NodeHandle Handle(size_t index) const;
+
+    // index of a node, or Size() if it has been deleted
+    size_t Find(NodeHandle handle) const;
+    bool Contains(NodeHandle handle) const;
+
+    // inserts before index, or at the end when index is Size(). the new
+    // node's segment data is left for the owner to fill in.
+    NodeHandle Insert(size_t index, const SplineNode& node);
+    void Set(size_t index, const SplineNode& node);
+    void Erase(size_t index);
+
+    // replaces everything, handing out new handles
+    void Assign(
+        const vec3* points,
+        const vec3* controls,
+        const vec3* normals,
+        size_t count);
+
+    // the chunks in order. restoring them keeps the handles and segment
+    // data they hold, and chunks still held elsewhere are shared rather
+    // than copied.
+    const std::vector<std::shared_ptr<const Chunk>>& Chunks() const;
+    void Restore(const std::vector<std::shared_ptr<const Chunk>>& chunks);
+
+    // chunk holding index, and the index of its first node
+    size_t Locate(size_t index, size_t& first) const;
+
+    // chunk holding a distance from the start, clamped to the track, and
+    // the distance at its start
+    size_t LocateDistance(double distance, size_t& first, double& start) const;
+
+    // index of the first node and distance at the start of a chunk
+    size_t First(size_t chunk) const;
+    double Start(size_t chunk) const;
+
+    // summed length of every chunk
+    double Length() const;
+
+    // a chunk for its segment data to be written, copied first if a copy
+    // still holds it. Refresh then sums its offsets and refits its boxes,
+    // and RefreshAll does so for every chunk after a bulk change.
+    Chunk& Write(size_t chunk);
+    void Refresh(size_t chunk);
+    void RefreshAll();
+
+    // appends the segments whose hulls are inside the frustum in index
+    // order, as Bvh::Cull does
+    void Cull(
+        const Frustum& frustum,
+        float margin,
+        bool ground,
+        std::vector<size_t>& visible) const;
+
+    // appends the nodes whose boxes pass test in index order, descending
+    // only into chunks whose boxes pass it too
+    template <typename F, typename Items>
+    void QueryNodes(
+        F test,
+        Items& items) const;
+
+    // bytes of chunks copied on write because a copy still held them
+    size_t CopiedBytes() const;
+
+private:
+    struct Location
+    {
+        uint32_t chunk = UINT32_MAX;
+        uint32_t slot = 0;
+    };
+
+    // what the tree keeps for every chunk below a node
+    struct Summary
+    {
+        size_t count = 0;
+        double length = 0.0;
+        Aabb bounds;
+        Aabb node_bounds;
+    };
+
+    std::vector<std::shared_ptr<const Chunk>> chunks;
+
+    // stable id of each chunk, the position of each id, and ids free to
+    // be given to new chunks
+    std::vector<uint32_t> chunk_ids;
+    std::vector<uint32_t> chunk_positions;
+    std::vector<uint32_t> free_chunk_ids;
+
+    // implicit complete binary tree over the chunks, tree[1] is the root
+    // and chunk c is tree[leaf_base + c]
+    std::vector<Summary> tree;
+    size_t leaf_base = 1;
+    size_t leaf_depth = 0;
+
+    std::vector<Location> locations;
+    NodeHandle next_handle = 0;
+
+    size_t copied_bytes = 0;
+
+    void SetLocations(size_t chunk, size_t from);
+    void InsertChunk(size_t position, std::shared_ptr<const Chunk> chunk);
+    void EraseChunk(size_t position);
+
+    // the leaf of one chunk and every node above it, or the whole tree
+    void Summarise(size_t chunk);
+    void SetLeaf(size_t chunk);
+    void Join(size_t node);
+    void Rebuild();
+
+    // sums the chunks before one, in the same order LocateDistance adds
+    // them so both agree on where every chunk starts
+    void Prefix(size_t chunk, size_t& first, double& start) const;
+};
+
+template <typename F, typename Items>
+void SplineNodes::QueryNodes(
+    F test,
+    Items& items) const
+{
+    if (chunks.empty())
+    {
+        return;
+    }
+
+    // node, and the index of the first node below it
+    size_t stack[64][2];
+    size_t top = 0;
+
+    stack[top][0] = 1;
+    stack[top][1] = 0;
+    top++;
+
+    while (top > 0)
+    {
+        top--;
+        size_t node = stack[top][0];
+        size_t first = stack[top][1];
+
+        const Summary& summary = tree[node];
+
+        if (summary.node_bounds.Empty() || !test(summary.node_bounds))
+        {
+            continue;
+        }
+
+        if (node >= leaf_base)
+        {
+            size_t from = items.size();
+            chunks[node - leaf_base]->node_bounds.Query(test, items);
+
+            for (size_t k = from; k < items.size(); k++)
+            {
+                items[k] += first;
+            }
+
+            continue;
+        }
+
+        stack[top][0] = node * 2 + 1;
+        stack[top][1] = first + tree[node * 2].count;
+        top++;
+
+        stack[top][0] = node * 2;
+        stack[top][1] = first;
+        top++;
+    }
+}
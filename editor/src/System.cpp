@@ -1,5 +1,9 @@
 #include "System.hpp"
 
+#include "Allocation.hpp"
+#include "FrameArena.hpp"
+#include "Profiler.hpp"
+
 namespace SDLSystem
 {
     System* system;
@@ -11,7 +15,9 @@ namespace SDLSystem
     }
 
     System::System(
-        std::function<void()> update)
+        std::function<void()> update,
+        bool vsync) :
+        vsync(vsync)
     {
         render_update = update;
 
@@ -70,13 +76,14 @@ namespace SDLSystem
         SDL_SetRelativeMouseMode(static_cast<SDL_bool>(status));
     }
 
+    void System::RequestRedraw()
+    {
+        redraw = true;
+    }
+
     bool System::IsKeyDown(uint16_t key)
     {
-        if (key_state.find(key) != key_state.end())
-        {
-            return key_state[key];
-        }
-        return false;
+        return key_state[key];
     }
 
     void System::InitWindow()
@@ -92,7 +99,10 @@ namespace SDLSystem
             window_height,
             SDL_WINDOW_SHOWN);
 
-        renderer = SDL_CreateRenderer(window, -1, 0);
+        renderer = SDL_CreateRenderer(
+            window,
+            -1,
+            vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
 
         const char *error = SDL_GetError();
         if (*error != '\0')
@@ -117,11 +127,54 @@ namespace SDLSystem
         system->mouse_delta_x = 0;
         system->mouse_delta_y = 0;
 
+        // everything drawn has been submitted by now
+        FrameArena::Frame().Reset();
+
+        PROFILE_ZONE("present");
         SDL_RenderPresent(renderer);
     }
 
+    // holds a capped frame back until it is due, sleeping for most of
+    // the wait and yielding for the last part, which SDL_Delay is too
+    // coarse to hit
+    void System::WaitForFrame()
+    {
+        if (vsync || max_frame_rate == 0)
+        {
+            return;
+        }
+
+        uint64_t frequency = SDL_GetPerformanceFrequency();
+        uint64_t period = frequency / max_frame_rate;
+        uint64_t now = SDL_GetPerformanceCounter();
+
+        if (next_frame > now)
+        {
+            uint64_t margin = frequency / 500;
+
+            if (next_frame - now > margin)
+            {
+                SDL_Delay(static_cast<uint32_t>(
+                    (next_frame - now - margin) * 1000 / frequency));
+            }
+
+            while (SDL_GetPerformanceCounter() < next_frame)
+            {
+                SDL_Delay(0);
+            }
+
+            now = next_frame;
+        }
+
+        // a late frame moves the schedule rather than bunching up the next
+        next_frame = now + period;
+    }
+
     bool poll_events()
     {
+        PROFILE_ZONE("poll events");
+        ALLOCATION_TAG(AllocationTag::SYSTEM);
+
         system->mouse_down_prev = system->mouse_down;
 
         SDL_Event event;
@@ -131,6 +184,9 @@ namespace SDLSystem
 
         while (SDL_PollEvent(&event))
         {
+            // any input may change what is on screen
+            system->redraw = true;
+
             switch (event.type)
             {
             case SDL_QUIT:
@@ -164,8 +220,8 @@ namespace SDLSystem
             case SDL_MOUSEMOTION:
                 system->mouse_x = event.motion.x;
                 system->mouse_y = event.motion.y;
-                system->mouse_delta_x = event.motion.xrel;
-                system->mouse_delta_y = event.motion.yrel;
+                system->mouse_delta_x += event.motion.xrel;
+                system->mouse_delta_y += event.motion.yrel;
                 break;
 
             case SDL_WINDOWEVENT:
@@ -229,8 +285,29 @@ namespace SDLSystem
 
         while (!done)
         {
+            // sleep until input arrives unless a frame is already wanted
+            if (!redraw)
+            {
+                SDL_WaitEventTimeout(
+                    nullptr,
+                    static_cast<int>(idle_timeout));
+            }
+
             done = poll_events();
+
+            if (done || !redraw)
+            {
+                continue;
+            }
+
+            redraw = false;
+
+            WaitForFrame();
+
+            uint64_t start = profile_now();
             render_update_func();
+            profile_frame(start, profile_now());
+            allocation_frame();
         }
 
         Destroy();
@@ -54,6 +54,7 @@
 #include <stdexcept>
 #include <math.h>
 #include <map>
+#include <bitset>
 #include <memory>
 
 using std::cout;
@@ -116,13 +117,15 @@ namespace SDLSystem
     {
     private:
         void InitWindow();
+        void WaitForFrame();
 
     public:
         SDL_Window* window = nullptr;
         SDL_Renderer* renderer = nullptr;
 
         System(
-            std::function<void()> update);
+            std::function<void()> update,
+            bool vsync = false);
         virtual ~System();
 
         void Run();
@@ -132,8 +135,25 @@ namespace SDLSystem
         void SetMouseActive(bool status);
         bool IsKeyDown(uint16_t key);
 
+        // frames are only drawn on input, or when one has been asked for
+        // by something still changing
+        void RequestRedraw();
+
         std::function<void()> render_update;
-        std::map<uint16_t, bool> key_state;
+        // indexed by the key code truncated to 16 bits, as IsKeyDown takes it
+        std::bitset<1 << 16> key_state;
+
+        bool vsync = false;
+        bool redraw = true;
+
+        // frame rate cap when not waiting on vsync, zero for none
+        uint32_t max_frame_rate = 0;
+
+        // longest wait for input in milliseconds before drawing anyway
+        uint32_t idle_timeout = 1000;
+
+        // performance counter time the next capped frame is due
+        uint64_t next_frame = 0;
 
         bool mouse_active = false;
 
@@ -156,31 +176,4 @@ namespace SDLSystem
 
     using SystemPtr = shared_ptr<System>;
 
-    static Uint32 GetPixel(SDL_Surface *surf, int x, int y)
-    {
-        //This function returns pixels color
-        int bpp = surf->format->BytesPerPixel;
-        Uint8 *p = (Uint8 *)surf->pixels + y * surf->pitch + x * bpp;
-
-        switch (bpp)
-        {
-        case 1:
-            return *p;
-
-        case 2:
-            return *(Uint16 *)p;
-
-        case 3:
-            if (SDL_BYTEORDER == SDL_BIG_ENDIAN)
-                return p[0] << 16 | p[1] << 8 | p[2];
-            else
-                return p[0] | p[1] << 8 | p[2] << 16;
-
-        case 4:
-            return *(Uint32 *)p;
-
-        default:
-            return 0;
-        }
-    }
 }
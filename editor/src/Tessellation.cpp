@@ -0,0 +1,312 @@
+#include "Tessellation.hpp"
+
+#include "Allocation.hpp"
+#include "Profiler.hpp"
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size)
+{
+    // fnv-1a
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+uint64_t TrackTessellation::SegmentHash(Spline& spline, size_t i)
+{
+    const SplineNode& a = spline.Node(i);
+    const SplineNode& b = spline.Node((i + 1) % spline.count);
+
+    float data[19] = {
+        a.point.x, a.point.y, a.point.z,
+        a.control.x, a.control.y, a.control.z,
+        a.normal.x, a.normal.y, a.normal.z,
+        b.point.x, b.point.y, b.point.z,
+        b.control.x, b.control.y, b.control.z,
+        b.normal.x, b.normal.y, b.normal.z,
+        width };
+
+    return hash_bytes(0xcbf29ce484222325ull, data, sizeof(data));
+}
+
+const TrackSegmentMesh& TrackTessellation::Mesh(const Spline& spline, size_t i) const
+{
+    return meshes[spline.Handle(i)];
+}
+
+void TrackTessellation::Sweep(const Spline& spline)
+{
+    for (size_t k = 0; k < sweep_size && !meshes.empty(); k++)
+    {
+        sweep = sweep + 1 < meshes.size() ? sweep + 1 : 0;
+
+        TrackSegmentMesh& mesh = meshes[sweep];
+
+        if (mesh.left.capacity() > 0 && !spline.nodes.Contains(static_cast<NodeHandle>(sweep)))
+        {
+            mesh = TrackSegmentMesh();
+        }
+    }
+}
+
+void TrackTessellation::Invalidate()
+{
+    for (auto& mesh : meshes)
+    {
+        mesh.left.clear();
+    }
+}
+
+void TrackTessellation::Update(
+    Spline& spline,
+    const std::vector<size_t>& visible)
+{
+    PROFILE_ZONE("TrackTessellation::Update");
+    ALLOCATION_TAG(AllocationTag::TESSELLATION);
+
+    rebuilt = 0;
+
+    Sweep(spline);
+
+    pending.clear();
+    pending_handles.clear();
+    pending_hashes.clear();
+
+    for (size_t i : visible)
+    {
+        NodeHandle handle = spline.Handle(i);
+
+        if (handle >= meshes.size())
+        {
+            meshes.resize(handle + 1);
+        }
+
+        TrackSegmentMesh& mesh = meshes[handle];
+        int level = Level(spline, i, pixel_error);
+
+        // a preview mesh is kept until the preview ends
+        bool settled = mesh.level == level || (preview && mesh.coarse);
+
+        // hashes only need checking after an edit
+        if (mesh.revision == spline.revision && !mesh.left.empty() && settled)
+        {
+            continue;
+        }
+
+        uint64_t hash = SegmentHash(spline, i);
+        bool changed = mesh.hash != hash || mesh.left.empty();
+
+        mesh.revision = spline.revision;
+
+        if (!changed && settled)
+        {
+            continue;
+        }
+
+        mesh.level = level;
+        mesh.coarse = false;
+
+        if (changed && preview)
+        {
+            mesh.level = Level(spline, i, preview_pixel_error);
+            mesh.coarse = mesh.level != level;
+        }
+
+        pending.push_back(i);
+        pending_handles.push_back(handle);
+        pending_hashes.push_back(hash);
+    }
+
+    rebuilt = pending.size();
+
+    if (pending.empty())
+    {
+        return;
+    }
+
+    // each segment only writes its own mesh
+    JobSystem::Default().ParallelFor(
+        pending.size(),
+        parallel_grain,
+        [&](size_t first, size_t last)
+    {
+        PROFILE_ZONE("tessellate");
+        ALLOCATION_TAG(AllocationTag::TESSELLATION);
+
+        Scratch scratch;
+
+        for (size_t k = first; k < last; k++)
+        {
+            TrackSegmentMesh& mesh = meshes[pending_handles[k]];
+            Tessellate(spline, pending[k], mesh, scratch);
+            mesh.hash = pending_hashes[k];
+        }
+    });
+}
+
+int TrackTessellation::Level(const Spline& spline, size_t i, float error) const
+{
+    // distance to the nearest point of the hull's box
+    const Aabb& box = spline.Bounds(i);
+    vec3 nearest = glm::clamp(view_position, box.min, box.max);
+    float tolerance = error * pixel_size * glm::distance(view_position, nearest);
+
+    if (tolerance <= min_tolerance)
+    {
+        return 0;
+    }
+
+    // snapped down to a power of two times the finest tolerance
+    return glm::min(static_cast<int>(log2f(tolerance / min_tolerance)), 64);
+}
+
+// the furthest the inner control points lie from the chord, which bounds
+// how far the curve strays from a straight line between its ends
+static float hull_flatness(const vec3 (&hull)[4])
+{
+    vec3 chord = hull[3] - hull[0];
+    float length = glm::length(chord);
+
+    vec3 a = hull[1] - hull[0];
+    vec3 b = hull[2] - hull[0];
+
+    if (length > 1e-6f)
+    {
+        vec3 u = chord / length;
+        a -= u * glm::dot(a, u);
+        b -= u * glm::dot(b, u);
+    }
+
+    return sqrtf(glm::max(glm::dot(a, a), glm::dot(b, b)));
+}
+
+void TrackTessellation::Subdivide(
+    const Spline& spline,
+    size_t i,
+    const vec3 (&hull)[4],
+    float t0,
+    float t1,
+    float tolerance,
+    int depth,
+    std::vector<float>& parameters)
+{
+    // the rails sit width to either side, so they also stray by how far
+    // the side direction turns over the piece
+    vec3 side0 = spline.GetFrame(i, t0) * vec3(1, 0, 0);
+    vec3 side1 = spline.GetFrame(i, t1) * vec3(1, 0, 0);
+    float half_cos = sqrtf(glm::clamp(0.5f + 0.5f * glm::dot(side0, side1), 0.0f, 1.0f));
+
+    float error = hull_flatness(hull) + width * (1.0f - half_cos);
+
+    if (depth < max_depth && error > tolerance)
+    {
+        // de casteljau split at the middle
+        vec3 ab = (hull[0] + hull[1]) * 0.5f;
+        vec3 bc = (hull[1] + hull[2]) * 0.5f;
+        vec3 cd = (hull[2] + hull[3]) * 0.5f;
+        vec3 abc = (ab + bc) * 0.5f;
+        vec3 bcd = (bc + cd) * 0.5f;
+        vec3 mid = (abc + bcd) * 0.5f;
+
+        const vec3 left[4] = { hull[0], ab, abc, mid };
+        const vec3 right[4] = { mid, bcd, cd, hull[3] };
+
+        float tm = (t0 + t1) * 0.5f;
+
+        Subdivide(spline, i, left, t0, tm, tolerance, depth + 1, parameters);
+        Subdivide(spline, i, right, tm, t1, tolerance, depth + 1, parameters);
+
+        return;
+    }
+
+    parameters.push_back(t1);
+}
+
+void TrackTessellation::Tessellate(
+    Spline& spline,
+    size_t i,
+    TrackSegmentMesh& mesh,
+    Scratch& scratch)
+{
+    std::vector<uint32_t>& segments = scratch.segments;
+    std::vector<float>& parameters = scratch.parameters;
+    std::vector<float>& samples = scratch.samples;
+
+    const SplineNode& node = spline.Node(i);
+    const SplineNode& next = spline.Node((i + 1) % spline.count);
+
+    const vec3 hull[4] = {
+        node.point,
+        node.point + node.control,
+        next.point - next.control,
+        next.point };
+
+    // both ends and as many points between as the tolerance needs
+    parameters.clear();
+    parameters.push_back(0.0f);
+
+    Subdivide(
+        spline,
+        i,
+        hull,
+        0.0f,
+        1.0f,
+        ldexpf(min_tolerance, mesh.level),
+        0,
+        parameters);
+
+    size_t n = parameters.size();
+
+    // the end at t = 1 stays in this segment rather than becoming the
+    // start of the next
+    segments.assign(n, static_cast<uint32_t>(i));
+    samples.resize(n * 9);
+
+    SplineSamples out;
+
+    for (int a = 0; a < 3; a++)
+    {
+        out.position[a] = &samples[n * a];
+        out.gradient[a] = &samples[n * (a + 3)];
+        out.normal[a] = &samples[n * (a + 6)];
+    }
+
+    spline.Evaluate(segments.data(), parameters.data(), n, out);
+
+    mesh.left.resize(n);
+    mesh.right.resize(n);
+    mesh.left_ground.resize(n);
+    mesh.right_ground.resize(n);
+
+    for (size_t k = 0; k < n; k++)
+    {
+        vec3 position(
+            out.position[0][k],
+            out.position[1][k],
+            out.position[2][k]);
+
+        vec3 gradient = glm::normalize(vec3(
+            out.gradient[0][k],
+            out.gradient[1][k],
+            out.gradient[2][k]));
+
+        vec3 normal(
+            out.normal[0][k],
+            out.normal[1][k],
+            out.normal[2][k]);
+
+        // the slerped normal is only square to the curve at the stored
+        // frames, so the side is normalised to keep the rails width apart
+        vec3 side = glm::normalize(glm::cross(gradient, normal)) * width;
+
+        mesh.left[k] = position + side;
+        mesh.right[k] = position - side;
+        mesh.left_ground[k] = vec3(mesh.left[k].x, 0, mesh.left[k].z);
+        mesh.right_ground[k] = vec3(mesh.right[k].x, 0, mesh.right[k].z);
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "Math.hpp"
+#include "Spline.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// vertex runs for one segment of the track, from its start to its end
+struct TrackSegmentMesh
+{
+    uint64_t hash = 0;
+
+    // spline revision the hash was last checked against
+    uint64_t revision = 0;
+
+    // tolerance level the mesh was built at, and whether that was the
+    // preview tolerance
+    int level = 0;
+    bool coarse = false;
+
+    std::vector<vec3> left;
+    std::vector<vec3> right;
+    std::vector<vec3> left_ground;
+    std::vector<vec3> right_ground;
+};
+
+// track geometry cached per segment, built on first use and rebuilt only
+// for segments whose nodes or tessellation settings have changed. each
+// segment is subdivided until its rails are within a world tolerance
+// matching a few pixels at its distance from the view, with tolerances
+// snapped to powers of two so moving the view only rebuilds segments
+// whose distance has changed by a factor of two.
+class TrackTessellation
+{
+public:
+    float width = 0.2f;
+
+    // most the tessellated rails may stray from the true ones, in pixels
+    float pixel_error = 0.5f;
+
+    // while preview is set, segments whose shape changes are rebuilt at
+    // the coarser preview_pixel_error, and refined once it is cleared
+    bool preview = false;
+    float preview_pixel_error = 4.0f;
+
+    // world size of one pixel at a view depth of one, and the view
+    float pixel_size = 0.0f;
+    vec3 view_position;
+
+    // finest tolerance in world units, and deepest subdivision
+    float min_tolerance = 1e-3f;
+    int max_depth = 8;
+
+    // meshes by the handle of the node each segment starts at, so
+    // inserting or deleting nodes leaves every other mesh where it is
+    std::vector<TrackSegmentMesh> meshes;
+
+    // segments re-tessellated by the last Update
+    size_t rebuilt = 0;
+
+    // meshes checked per Update for nodes that have been deleted
+    size_t sweep_size = 64;
+
+    // brings the listed segments up to date, others are left untouched
+    void Update(Spline& spline, const std::vector<size_t>& visible);
+    void Invalidate();
+
+    // mesh of segment i, once Update has been given it
+    const TrackSegmentMesh& Mesh(const Spline& spline, size_t i) const;
+
+    // segments re-tessellated per job
+    size_t parallel_grain = 8;
+
+private:
+    // buffers for one thread of tessellation
+    struct Scratch
+    {
+        // each sample's segment and t within it
+        std::vector<uint32_t> segments;
+        std::vector<float> parameters;
+        std::vector<float> samples;
+    };
+
+    // segments found out of date, their nodes and their new hashes
+    std::vector<size_t> pending;
+    std::vector<NodeHandle> pending_handles;
+    std::vector<uint64_t> pending_hashes;
+
+    // last mesh checked by Sweep
+    size_t sweep = 0;
+
+    uint64_t SegmentHash(Spline& spline, size_t i);
+
+    // frees the meshes of a few deleted nodes, going round all of them
+    // over many updates
+    void Sweep(const Spline& spline);
+
+    // tolerance level for a pixel error at the segment's distance
+    int Level(const Spline& spline, size_t i, float error) const;
+
+    // appends the end of each flat enough piece of [t0, t1] of segment i
+    void Subdivide(
+        const Spline& spline,
+        size_t i,
+        const vec3 (&hull)[4],
+        float t0,
+        float t1,
+        float tolerance,
+        int depth,
+        std::vector<float>& parameters);
+
+    void Tessellate(
+        Spline& spline,
+        size_t i,
+        TrackSegmentMesh& mesh,
+        Scratch& scratch);
+};
@@ -0,0 +1,135 @@
+#include "VertexPipeline.hpp"
+
+#include "Simd.hpp"
+
+#if defined (SIMD_SSE2)
+#include <emmintrin.h>
+#endif
+
+void transform_vertices(
+    const mat4& m,
+    const vec3* in,
+    vec4* out,
+    size_t n)
+{
+#if defined (SIMD_SSE2)
+    // columns stay in registers, each vertex is a broadcast multiply-add
+    const __m128 c0 = _mm_loadu_ps(&m[0][0]);
+    const __m128 c1 = _mm_loadu_ps(&m[1][0]);
+    const __m128 c2 = _mm_loadu_ps(&m[2][0]);
+    const __m128 c3 = _mm_loadu_ps(&m[3][0]);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        __m128 r = _mm_add_ps(
+            _mm_add_ps(
+                _mm_mul_ps(c0, _mm_set1_ps(in[i].x)),
+                _mm_mul_ps(c1, _mm_set1_ps(in[i].y))),
+            _mm_add_ps(
+                _mm_mul_ps(c2, _mm_set1_ps(in[i].z)),
+                c3));
+
+        _mm_storeu_ps(&out[i][0], r);
+    }
+#else
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i] = m * vec4(in[i], 1.0f);
+    }
+#endif
+}
+
+void VertexPipeline::Clear()
+{
+    vertices.clear();
+    indices.clear();
+}
+
+uint32_t VertexPipeline::AddVertex(vec3 v)
+{
+    vertices.push_back(v);
+    return static_cast<uint32_t>(vertices.size() - 1);
+}
+
+void VertexPipeline::AddLine(uint32_t a, uint32_t b)
+{
+    indices.push_back(a);
+    indices.push_back(b);
+}
+
+void VertexPipeline::Run(
+    const mat4& projection_view,
+    float near_z,
+    float width,
+    float height,
+    ArenaVector<float>& segments) const
+{
+    size_t n = vertices.size();
+
+    ArenaVector<vec4> clip(n);
+    ArenaVector<vec2> screen(n);
+    segments.reserve(segments.size() + indices.size() * 2);
+
+    transform_vertices(projection_view, vertices.data(), clip.data(), n);
+
+    float half_width = width / 2.0f;
+    float half_height = height / 2.0f;
+
+    // vertices in front of the near plane are projected once
+    for (size_t i = 0; i < n; i++)
+    {
+        const vec4& p = clip[i];
+
+        if (p.z + near_z >= 0)
+        {
+            float d = 1.0f / p.w;
+            screen[i] = vec2(
+                p.x * d * width + half_width,
+                p.y * d * height + half_height);
+        }
+    }
+
+    for (size_t i = 0; i + 1 < indices.size(); i += 2)
+    {
+        uint32_t a = indices[i];
+        uint32_t b = indices[i + 1];
+
+        float d0 = clip[a].z + near_z;
+        float d1 = clip[b].z + near_z;
+
+        if (d0 < 0 && d1 < 0)
+        {
+            continue;
+        }
+
+        vec2 s0 = screen[a];
+        vec2 s1 = screen[b];
+
+        // lines crossing the near plane are clipped individually
+        if (d0 < 0 || d1 < 0)
+        {
+            vec4 p0 = clip[a];
+            vec4 p1 = clip[b];
+
+            if (d0 < 0)
+            {
+                p0 = p0 + (p1 - p0) * (d0 / (d0 - d1));
+                s0 = vec2(
+                    p0.x / p0.w * width + half_width,
+                    p0.y / p0.w * height + half_height);
+            }
+            else
+            {
+                p1 = p1 + (p0 - p1) * (d1 / (d1 - d0));
+                s1 = vec2(
+                    p1.x / p1.w * width + half_width,
+                    p1.y / p1.w * height + half_height);
+            }
+        }
+
+        segments.push_back(s0.x);
+        segments.push_back(s0.y);
+        segments.push_back(s1.x);
+        segments.push_back(s1.y);
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Math.hpp"
+#include "FrameArena.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// transforms a shared vertex array once per frame, then clips indexed line
+// lists against the near plane into screen space segments
+class VertexPipeline
+{
+public:
+    // world space input
+    std::vector<vec3> vertices;
+    std::vector<uint32_t> indices;
+
+    void Clear();
+    uint32_t AddVertex(vec3 v);
+    void AddLine(uint32_t a, uint32_t b);
+
+    // appends the visible lines as x0 y0 x1 y1. the clip and screen space
+    // vertices in between come from the frame arena.
+    void Run(
+        const mat4& projection_view,
+        float near_z,
+        float width,
+        float height,
+        ArenaVector<float>& segments) const;
+};
+
+// clip = m * vec4(v, 1) for each input vertex
+void transform_vertices(
+    const mat4& m,
+    const vec3* in,
+    vec4* out,
+    size_t n);
@@ -0,0 +1,685 @@
+#include "Autosave.hpp"
+#include "DrawCommands.hpp"
+#include "File.hpp"
+#include "History.hpp"
+#include "Spline.hpp"
+#include "SplineCursor.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+static void check(bool ok, const char* what, const char* file, int line)
+{
+    if (!ok)
+    {
+        failures++;
+        printf("  %s:%d: failed: %s\n", file, line, what);
+    }
+}
+
+static uint32_t random_state = 12345;
+
+static float random_float(float lo, float hi)
+{
+    random_state = random_state * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (random_state >> 8) / 16777216.0f;
+}
+
+static size_t random_index(size_t count)
+{
+    random_state = random_state * 1664525u + 1013904223u;
+    return (random_state >> 8) % count;
+}
+
+// a loop of count nodes, with long random controls when control_scale
+// is set, which give tight loops and near cusps
+static Spline make_track(size_t count, float control_scale)
+{
+    Spline spline;
+    spline.BeginEdit();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        float a = 6.2831853f * i / count;
+        float r = 0.5f * count;
+
+        spline.InsertPoint(vec3(
+            cosf(a) * r + random_float(-1.0f, 1.0f),
+            random_float(0.0f, 2.0f),
+            sinf(a) * r + random_float(-1.0f, 1.0f)));
+    }
+
+    for (size_t i = 0; i < count && control_scale > 0.0f; i++)
+    {
+        spline.MoveControl(i, spline.Node(i).point + control_scale * vec3(
+            random_float(-1.0f, 1.0f),
+            random_float(-1.0f, 1.0f),
+            random_float(-1.0f, 1.0f)));
+    }
+
+    spline.EndEdit();
+
+    return spline;
+}
+
+static std::vector<SplineNode> nodes_of(const Spline& spline)
+{
+    std::vector<SplineNode> nodes;
+
+    for (size_t i = 0; i < spline.count; i++)
+    {
+        nodes.push_back(spline.Node(i));
+    }
+
+    return nodes;
+}
+
+static bool same_nodes(const Spline& spline, const std::vector<SplineNode>& nodes)
+{
+    if (spline.count != nodes.size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        const SplineNode& a = spline.Node(i);
+        const SplineNode& b = nodes[i];
+
+        if (a.point != b.point || a.control != b.control || a.normal != b.normal)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void test_draw_commands()
+{
+    DrawCommandBuffer commands;
+
+    // two red lines, a red dot, a red line again and a blue outline
+    commands.SetColor(255, 0, 0, 255);
+    commands.Line(0, 0, 1, 1);
+    commands.Line(1, 1, 2, 0);
+    commands.Circle(5, 5, 3, true);
+    commands.Line(2, 0, 3, 3);
+    commands.SetColor(0, 0, 255, 128);
+    commands.Circle(7, 8, 4, false);
+
+    // the second red line run is not merged into the first, as that
+    // would draw it under the dot
+    CHECK(commands.batch_count == 4);
+    CHECK(commands.PrimitiveCount() == 5);
+
+    const DrawBatch* b = commands.batches.data();
+
+    CHECK(b[0].primitive == DrawPrimitive::LINE);
+    CHECK(b[0].r == 255 && b[0].g == 0 && b[0].b == 0 && b[0].a == 255);
+    CHECK((std::vector<float>(b[0].data.begin(), b[0].data.end()) ==
+        std::vector<float>{ 0, 0, 1, 1, 1, 1, 2, 0 }));
+
+    CHECK(b[1].primitive == DrawPrimitive::FILLED_CIRCLE);
+    CHECK((std::vector<float>(b[1].data.begin(), b[1].data.end()) ==
+        std::vector<float>{ 5, 5, 3 }));
+
+    CHECK(b[2].primitive == DrawPrimitive::LINE);
+    CHECK(b[2].data.size() == 4);
+
+    CHECK(b[3].primitive == DrawPrimitive::CIRCLE);
+    CHECK(b[3].r == 0 && b[3].b == 255 && b[3].a == 128);
+
+    uint8_t r, g, bl, a;
+    commands.GetColor(r, g, bl, a);
+    CHECK(r == 0 && g == 0 && bl == 255 && a == 128);
+
+    commands.Clear();
+    CHECK(commands.batch_count == 0);
+    CHECK(commands.PrimitiveCount() == 0);
+
+    // batches are reused after a clear
+    commands.Line(0, 0, 1, 0);
+    CHECK(commands.batch_count == 1);
+    CHECK(commands.batches[0].data.size() == 4);
+
+    commands.Clear();
+}
+
+static void test_batch_evaluation()
+{
+    Spline spline = make_track(1500, 3.0f);
+
+    const size_t n = 5000;
+    std::vector<float> f(n);
+    std::vector<uint32_t> segments(n);
+    std::vector<float> t(n);
+    std::vector<float> d(n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        f[i] = static_cast<float>(spline.count) * i / n;
+        segments[i] = static_cast<uint32_t>(random_index(spline.count));
+        t[i] = random_float(0.0f, 1.0f);
+        d[i] = spline.total_length * i / n;
+    }
+
+    // the last of a segment, which takes its end frame from the next
+    t[0] = 1.0f;
+    segments[0] = static_cast<uint32_t>(spline.count - 1);
+
+    std::vector<float> data(n * 9);
+    SplineSamples out;
+
+    for (int a = 0; a < 3; a++)
+    {
+        out.position[a] = &data[n * a];
+        out.gradient[a] = &data[n * (a + 3)];
+        out.normal[a] = &data[n * (a + 6)];
+    }
+
+    auto sample = [&](size_t k)
+    {
+        return std::vector<vec3>{
+            vec3(out.position[0][k], out.position[1][k], out.position[2][k]),
+            vec3(out.gradient[0][k], out.gradient[1][k], out.gradient[2][k]),
+            vec3(out.normal[0][k], out.normal[1][k], out.normal[2][k]) };
+    };
+
+    // scale of the track, points are compared relative to it
+    float scale = 0.5f * spline.count;
+
+    float point_error = 0.0f;
+    float normal_error = 0.0f;
+
+    spline.Evaluate(f.data(), n, out);
+
+    for (size_t k = 0; k < n; k++)
+    {
+        std::vector<vec3> s = sample(k);
+        point_error = glm::max(point_error, glm::length(s[0] - spline.GetPoint(f[k])) / scale);
+        point_error = glm::max(point_error, glm::length(s[1] - spline.GetGradient(f[k])) / scale);
+        normal_error = glm::max(normal_error, glm::length(s[2] - spline.GetNormal(f[k])));
+    }
+
+    spline.Evaluate(segments.data(), t.data(), n, out);
+
+    for (size_t k = 0; k < n; k++)
+    {
+        std::vector<vec3> s = sample(k);
+        point_error = glm::max(point_error, glm::length(s[0] - spline.GetPoint(segments[k], t[k])) / scale);
+        point_error = glm::max(point_error, glm::length(s[1] - spline.GetGradient(segments[k], t[k])) / scale);
+        normal_error = glm::max(normal_error, glm::length(s[2] - spline.GetNormal(segments[k], t[k])));
+    }
+
+    spline.EvaluateAtDistances(d.data(), n, out);
+
+    for (size_t k = 0; k < n; k++)
+    {
+        float u = 0.0f;
+        size_t i = spline.FindParameter(d[k], u);
+
+        CHECK(spline.Offset(i) <= d[k] && d[k] <= spline.Offset(i + 1));
+
+        std::vector<vec3> s = sample(k);
+        point_error = glm::max(point_error, glm::length(s[0] - spline.GetPoint(i, u)) / scale);
+        normal_error = glm::max(normal_error, glm::length(s[2] - spline.GetNormal(i, u)));
+    }
+
+    CHECK(point_error < 1e-6f);
+    CHECK(normal_error < 1e-5f);
+
+    // the normal is the y axis of the frame, and a cursor walking the
+    // track agrees with both
+    SplineCursor cursor(spline);
+    float frame_error = 0.0f;
+
+    for (size_t k = 0; k < 2000; k++)
+    {
+        SplineCursorSample s = cursor.Advance(spline.total_length / 2000.0f * 0.7f);
+        quat q = spline.GetFrame(cursor.Segment(), cursor.Parameter());
+        vec3 normal = spline.GetNormal(cursor.Segment(), cursor.Parameter());
+
+        frame_error = glm::max(frame_error, 1.0f - fabsf(glm::dot(q, s.frame)));
+        frame_error = glm::max(frame_error, glm::length(q * vec3(0, 1, 0) - normal));
+    }
+
+    CHECK(frame_error < 1e-5f);
+}
+
+// dense chord sum of a segment in double precision
+static double reference_length(const Spline& spline, size_t node)
+{
+    const int steps = 20000;
+    size_t next = (node + 1) % spline.count;
+
+    dvec3 p0 = dvec3(spline.Node(node).point);
+    dvec3 p1 = p0 + dvec3(spline.Node(node).control);
+    dvec3 p3 = dvec3(spline.Node(next).point);
+    dvec3 p2 = p3 - dvec3(spline.Node(next).control);
+
+    double length = 0.0;
+    dvec3 old_point = p0;
+
+    for (int s = 1; s <= steps; s++)
+    {
+        double t = static_cast<double>(s) / steps;
+        double c = 1.0 - t;
+
+        dvec3 new_point =
+            p0 * (c * c * c) +
+            p1 * (3.0 * t * c * c) +
+            p2 * (3.0 * t * t * c) +
+            p3 * (t * t * t);
+
+        length += glm::length(new_point - old_point);
+        old_point = new_point;
+    }
+
+    return length;
+}
+
+static void test_arc_length()
+{
+    // long controls make tight loops and near cusps, the worst case for
+    // the adaptive integration
+    Spline spline = make_track(300, 20.0f);
+
+    double worst = 0.0;
+
+    for (size_t i = 0; i < spline.count; i++)
+    {
+        double reference = reference_length(spline, i);
+        double error = fabs(spline.Length(i) - reference) / reference;
+        worst = error > worst ? error : worst;
+
+        // the arc table rises to the segment's length
+        const float* arc = spline.ArcLengths(i);
+
+        for (size_t k = 1; k < Spline::arc_samples; k++)
+        {
+            CHECK(arc[k] >= arc[k - 1]);
+        }
+
+        CHECK(fabsf(arc[Spline::arc_samples - 1] - spline.Length(i)) <= 1e-4f * spline.Length(i));
+    }
+
+    // relative to each segment's length, as the tolerance is
+    CHECK(worst <= spline.length_tolerance);
+    printf("  worst relative length error %.2g, tolerance %.2g\n", worst, spline.length_tolerance);
+}
+
+static void test_node_storage()
+{
+    SplineNodes nodes;
+    std::vector<SplineNode> reference;
+    std::vector<NodeHandle> handles;
+
+    auto make_node = [](float x)
+    {
+        SplineNode node;
+        node.point = vec3(x, 0, 0);
+        return node;
+    };
+
+    // enough to split into many chunks, then inserts and erases anywhere
+    for (size_t i = 0; i < 3000; i++)
+    {
+        handles.push_back(nodes.Insert(i, make_node(static_cast<float>(i))));
+        reference.push_back(make_node(static_cast<float>(i)));
+    }
+
+    std::vector<NodeHandle> erased;
+
+    for (size_t step = 0; step < 6000; step++)
+    {
+        size_t op = random_index(3);
+
+        if (op == 0 || reference.size() < 10)
+        {
+            size_t i = random_index(reference.size() + 1);
+            SplineNode node = make_node(random_float(-1e3f, 1e3f));
+
+            handles.insert(handles.begin() + i, nodes.Insert(i, node));
+            reference.insert(reference.begin() + i, node);
+        }
+        else if (op == 1)
+        {
+            size_t i = random_index(reference.size());
+
+            erased.push_back(handles[i]);
+            nodes.Erase(i);
+            handles.erase(handles.begin() + i);
+            reference.erase(reference.begin() + i);
+        }
+        else
+        {
+            size_t i = random_index(reference.size());
+            SplineNode node = make_node(random_float(-1e3f, 1e3f));
+
+            nodes.Set(i, node);
+            reference[i] = node;
+        }
+    }
+
+    CHECK(nodes.Size() == reference.size());
+
+    bool values = true;
+    bool stable = true;
+    bool located = true;
+
+    for (size_t i = 0; i < reference.size(); i++)
+    {
+        values = values && nodes.Get(i).point == reference[i].point;
+        stable = stable && nodes.Handle(i) == handles[i] && nodes.Find(handles[i]) == i;
+
+        size_t first = 0;
+        size_t c = nodes.Locate(i, first);
+        located = located && nodes.Chunks()[c]->nodes[i - first].point == reference[i].point;
+    }
+
+    CHECK(values);
+    CHECK(stable);
+    CHECK(located);
+
+    // erased handles are gone unless they were handed out again
+    for (NodeHandle handle : erased)
+    {
+        size_t i = nodes.Find(handle);
+        CHECK(i == nodes.Size() || handles[i] == handle);
+    }
+
+    // copies share chunks until written
+    SplineNodes copy = nodes;
+    copy.Set(0, make_node(-5.0f));
+    CHECK(nodes.Get(0).point == reference[0].point);
+    CHECK(copy.Get(0).point == vec3(-5.0f, 0, 0));
+}
+
+static void test_history()
+{
+    Spline spline = make_track(700, 0.0f);
+
+    EditHistory history;
+    history.checkpoint_interval = 8;
+    history.Attach(spline);
+
+    std::vector<std::vector<SplineNode>> states;
+    states.push_back(nodes_of(spline));
+
+    for (size_t step = 0; step < 120; step++)
+    {
+        size_t i = random_index(spline.count);
+
+        switch (step % 5)
+        {
+        case 0:
+            spline.InsertPointAfter(i, spline.Node(i).point + vec3(0.5f, 0.2f, 0.5f));
+            break;
+        case 1:
+            spline.DeletePoint(i);
+            break;
+        case 2:
+            spline.InsertPointOnCurve(i, 0.3f);
+            break;
+        case 3:
+            // a drag is one entry
+            history.Begin();
+
+            for (int k = 0; k < 10; k++)
+            {
+                spline.MovePoint(i, spline.Node(i).point + vec3(0.1f, 0, 0));
+            }
+
+            history.End();
+            break;
+        default:
+            spline.MoveNormal(i, spline.Node(i).point + vec3(0.3f, 1, 0));
+            break;
+        }
+
+        states.push_back(nodes_of(spline));
+    }
+
+    CHECK(history.Position() == states.size() - 1);
+
+    history.Undo();
+    CHECK(same_nodes(spline, states[states.size() - 2]));
+
+    history.Redo();
+    CHECK(same_nodes(spline, states.back()));
+
+    bool jumps = true;
+
+    for (size_t k = 0; k < 60; k++)
+    {
+        size_t target = history.First() + random_index(history.Last() - history.First() + 1);
+        history.Jump(target);
+        jumps = jumps && history.Position() == target && same_nodes(spline, states[target]);
+    }
+
+    CHECK(jumps);
+
+    // the derived data follows the nodes as if built from scratch
+    history.Jump(history.Last());
+
+    std::vector<vec3> points, controls, normals;
+
+    for (const SplineNode& node : states.back())
+    {
+        points.push_back(node.point);
+        controls.push_back(node.control);
+        normals.push_back(node.normal);
+    }
+
+    Spline fresh;
+    fresh.Assign(points.data(), controls.data(), normals.data(), points.size());
+    fresh.Rebuild();
+
+    bool lengths = true;
+
+    for (size_t i = 0; i < fresh.count; i++)
+    {
+        lengths = lengths && spline.Length(i) == fresh.Length(i);
+    }
+
+    CHECK(lengths);
+
+    // a new edit after an undo drops the redo branch
+    history.Undo();
+    spline.MovePoint(0, vec3(1, 2, 3));
+    CHECK(history.Position() == history.Last());
+}
+
+static void test_track_view()
+{
+    Spline spline = make_track(1000, 0.0f);
+
+    std::ostringstream os;
+    save_track(os, spline);
+    std::string file = os.str();
+
+    // stored 8 byte aligned, as the chunks are read in place
+    std::vector<uint64_t> buffer;
+
+    auto open = [&](const std::string& bytes, TrackView& view)
+    {
+        buffer.assign((bytes.size() + 7) / 8, 0);
+        memcpy(buffer.data(), bytes.data(), bytes.size());
+        return view.Open(reinterpret_cast<const char*>(buffer.data()), bytes.size());
+    };
+
+    {
+        TrackView view;
+        CHECK(open(file, view));
+
+        Spline loaded;
+        CHECK(load_track(view, loaded));
+        CHECK(same_nodes(loaded, nodes_of(spline)));
+    }
+
+    // truncated anywhere, including inside the header and the table
+    const size_t cuts[] = { 0, 7, 32, 63, 64, 100, file.size() / 2, file.size() - 1 };
+
+    for (size_t cut : cuts)
+    {
+        TrackView view;
+        CHECK(!open(file.substr(0, cut), view));
+    }
+
+    // node counts that overflow when multiplied by the element size
+    const uint64_t counts[] = { (1ull << 62) + 1000, 1001, 999, UINT64_MAX };
+
+    for (uint64_t count : counts)
+    {
+        std::string bytes = file;
+        TrackFileHeader header;
+        memcpy(&header, bytes.data(), sizeof(header));
+        header.node_count = count;
+        memcpy(&bytes[0], &header, sizeof(header));
+
+        TrackView view;
+        CHECK(!open(bytes, view));
+    }
+
+    // a flipped bit in the chunk table fails its crc
+    {
+        std::string bytes = file;
+        bytes[sizeof(TrackFileHeader) + 9] ^= 1;
+
+        TrackView view;
+        CHECK(!open(bytes, view));
+    }
+
+    // a flipped bit in the points is caught when verifying, and bad
+    // caches are integrated again rather than trusted
+    {
+        TrackView reference;
+        open(file, reference);
+        size_t points = reference.Find(CHUNK_POINTS)->offset;
+        size_t arcs = reference.Find(CHUNK_ARC_LENGTHS)->offset;
+
+        std::string bytes = file;
+        bytes[points + 5] ^= 1;
+
+        TrackView view;
+        CHECK(open(bytes, view));
+
+        Spline loaded;
+        CHECK(!load_track(view, loaded));
+
+        bytes = file;
+        bytes[arcs + 5] ^= 1;
+
+        CHECK(open(bytes, view));
+        CHECK(load_track(view, loaded));
+        CHECK(fabsf(loaded.total_length - spline.total_length) <= 1e-3f);
+    }
+
+    // v1 files with counts past the end of the stream fail cleanly
+    {
+        std::ostringstream v1;
+        std::vector<vec3> points(5, vec3(1));
+        uint64_t huge = 1ull << 60;
+
+        v1.write(reinterpret_cast<const char*>(&huge), sizeof(huge));
+        v1.write(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(vec3));
+
+        std::istringstream is(v1.str());
+        std::vector<vec3> p, c, n;
+        CHECK(!read_track_v1(is, p, c, n));
+    }
+}
+
+static void test_journal_replay()
+{
+    const std::string path = "superrocket-test.track";
+    remove(path.c_str());
+    remove((path + ".journal").c_str());
+
+    Spline spline = make_track(200, 0.0f);
+
+    {
+        TrackAutosave autosave;
+        spline.AddListener([&](const SplineEdit& edit)
+        {
+            autosave.Record(edit);
+        });
+
+        autosave.Save(path, spline);
+        autosave.Wait();
+
+        for (size_t i = 0; i < 50; i++)
+        {
+            spline.MovePoint(i * 3, spline.Node(i * 3).point + vec3(0, 1, 0));
+        }
+
+        spline.MoveControl(3, spline.Node(3).point + vec3(1, 1, 1));
+        spline.MoveNormal(4, spline.Node(4).point + vec3(1, 0, 0));
+        spline.InsertPointAfter(10, vec3(5, 5, 5));
+        spline.InsertPointOnCurve(20, 0.25f);
+        spline.DeletePoint(30);
+
+        autosave.Wait();
+        spline.listeners.clear();
+    }
+
+    // as after a crash, the saved track with the journal replayed on it
+    Spline replayed;
+    CHECK(load_track(path, replayed));
+
+    TrackAutosave autosave;
+    size_t edits = autosave.Open(path, replayed);
+
+    CHECK(edits == 55);
+    CHECK(same_nodes(replayed, nodes_of(spline)));
+    CHECK(replayed.total_length == spline.total_length);
+
+    // a record torn by the crash ends the replay
+    FILE* journal = fopen((path + ".journal").c_str(), "ab");
+    CHECK(journal != nullptr);
+
+    if (journal != nullptr)
+    {
+        fwrite("torn", 1, 4, journal);
+        fclose(journal);
+    }
+
+    Spline torn;
+    CHECK(load_track(path, torn));
+
+    TrackAutosave again;
+    CHECK(again.Open(path, torn) == 55);
+    CHECK(same_nodes(torn, nodes_of(spline)));
+
+    remove(path.c_str());
+    remove((path + ".journal").c_str());
+}
+
+static void run(const char* name, void (*test)())
+{
+    int before = failures;
+    test();
+    printf("%-24s %s\n", name, failures == before ? "ok" : "FAILED");
+}
+
+int main()
+{
+    run("draw commands", test_draw_commands);
+    run("batch evaluation", test_batch_evaluation);
+    run("arc length", test_arc_length);
+    run("node storage", test_node_storage);
+    run("history", test_history);
+    run("track view", test_track_view);
+    run("journal replay", test_journal_replay);
+
+    return failures == 0 ? 0 : 1;
+}